@@ -0,0 +1,64 @@
+// Generated by Kern_aot, do not edit.
+// Call aotTest_load(k, dict) after compiling the fngi source of dict.
+#include "fngi.h"
+
+static TyFn* aot_f[3];
+static Ty* aot_r[3];
+static void aot_0(Kern* k);
+static void aot_1(Kern* k);
+
+static void aot_0(Kern* k) { // aotChk
+  U1* l = fnEnter(k, aot_f[0]);
+  *(U4*)(l + 0) = WS_POP(); WS_ADD(*(U4*)(l + 0));
+  aot_1(k);
+  WS_ADD(*(U4*)(l + 0));
+  WS_ADD(*(U4*)(l + 0));
+  WS_ADD(WS_POP() + 1);
+  { S r = WS_POP(); WS_ADD(WS_POP() * r); }
+  WS_ADD(2);
+  { S r = WS_POP(); WS_ADD(WS_POP() / r); }
+  WS_ADD(WS_POP() + 3);
+  xImpl(k, aot_r[0]);
+  goto done;
+done:
+  ret(k);
+}
+
+static void aot_1(Kern* k) { // aotSum
+  U1* l = fnEnter(k, aot_f[1]);
+  *(U4*)(l + 0) = WS_POP();
+  WS_ADD(*(U4*)((U1*)((TyVar*)aot_r[1])->v + 0));
+  *(U4*)(l + 4) = WS_POP();
+L13:
+  WS_ADD(*(U4*)(l + 0));
+  WS_ADD(0);
+  { WS_POP2(S a, S b); if(a != b) goto L24; }
+  WS_ADD(*(U4*)(l + 4));
+  goto L40;
+L24:
+  WS_ADD(*(U4*)(l + 4) + *(U4*)(l + 0));
+  *(U4*)(l + 4) = WS_POP(); WS_ADD(*(U4*)(l + 0));
+  WS_ADD(WS_POP() - 1);
+  *(U4*)(l + 0) = WS_POP();
+  goto L13;
+L40:
+  goto done;
+done:
+  ret(k);
+}
+
+static AotFn aot_fns[] = {
+  { (CStr*)"\006aotChk", aot_0, &aot_f[0], 29, 1 },
+  { (CStr*)"\006aotSum", aot_1, &aot_f[1], 41, 2 },
+  {0}
+};
+
+static AotRef aot_refs[] = {
+  { (CStr*)"\011tAssertEq", true },
+  { (CStr*)"\004aotG", false },
+  {0}
+};
+
+U2 aotTest_load(Kern* k, TyDict* dict) {
+  return Kern_aotLoad(k, dict, aot_fns, aot_refs, aot_r);
+}
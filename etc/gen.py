@@ -17,7 +17,7 @@ SZ1 = r.vals.SZ1
 SZ2 = r.vals.SZ2
 SZ4 = r.vals.SZ4
 
-unsized = {'LCL', 'XL', 'JW', 'XLL', 'XRL', 'SLIT'}
+unsized = {'LCL', 'XL', 'JW', 'XLL', 'XRL', 'XLT', 'SLIT'}
 
 def writeCase(f, name, ret=None):
   ret = ret or name
@@ -46,3 +46,259 @@ with open('gen/name.c', 'w') as f:
   f.write('  }\n')
   f.write('  return (Slc) {.dat = unknownInstr, .len = 7};\n')
   f.write('}\n')
+
+# Dispatch table for the threaded (computed goto) executeInstr. It must be
+# included inside executeInstr, which defines an I_<name> label per instr.
+def labels():
+  out = ['UNKNOWN'] * 0x100
+  for instr, name in instrs:
+    if name == 'SLIT':
+      for v in range(instr, 0x100): out[v] = 'SLIT'
+    elif instr < 0x40 or name in unsized: out[instr] = name
+    else:
+      for sz in ('1', '2', '4'):
+        out[instr + r.vals['SZ' + sz]] = name + sz
+  return out
+
+with open('gen/instrTbl.inc', 'w') as f:
+  f.write('/* Custom generated by etc/gen.py */\n')
+  f.write('// Must be included inside of executeInstr (FNGI_THREADED)\n\n')
+  f.write('static const void* const instrTbl[0x100] = {\n')
+  for i, label in enumerate(labels()):
+    f.write(f'  /*0x{i:02X}*/ &&I_{label},\n')
+  f.write('};\n')
+
+# The builtin dictionary: Ty_builtins (under rootDict on the dictStk) and its
+# comp mod. It is constant initialized so Kern_init does no work to register
+# it. Each dict's children are a balanced bst (ordered like Slc_cmp) and every
+# entry is also in builtinSyms, an open addressing table keyed by nameHash
+# (FNV-1a) of the name, see Kern_findTy.
+BUILTIN_TBL = 256 # power of 2, must match fngi.h
+
+class B:
+  def __init__(s, name, ty, meta, fields, var=None, cond=None, code=None):
+    s.name, s.ty, s.meta, s.fields = name.encode(), ty, meta, fields
+    s.var, s.cond, s.code = var, cond, code
+    s.l = s.r = None
+
+def withMeta(base, meta): return base if meta == '0' else f'{base} | {meta}'
+
+def native(name, meta, sz, var=None):
+  return B(name, 'TyDict', withMeta('TY_DICT | TY_DICT_NATIVE', meta),
+           [('children', f'(Ty*)({sz})')], var=var or name)
+
+def fn(name, meta, code, inp='TYI_VOID', out='TYI_VOID', var=None, cond=None):
+  return B(name, 'TyFn', withMeta('TY_FN | TY_FN_NATIVE', meta),
+           [('code', f'(U1*){code}'), ('inp', inp), ('out', out)], var=var, cond=cond)
+
+def inline(name, inp, out, *instrs):
+  b = B(name, 'TyFn', 'TY_FN | TY_FN_NATIVE | TY_FN_INLINE',
+        [('inp', inp), ('out', out), ('len', str(len(instrs)))])
+  b.code = ', '.join(instrs + ('RET',))
+  return b
+
+builtins = [
+  native('Ty_UNSET', '0', 'SZR + 1'),
+  native('Any',      '0', 'SZR + 1', var='Ty_Any'),
+  native('Unsafe',   '0', 'SZR + 1', var='Ty_Unsafe'),
+  native('U1', '0',                'SZ1', var='Ty_U1'),
+  native('U2', '0',                'SZ2', var='Ty_U2'),
+  native('U4', '0',                'SZ4', var='Ty_U4'),
+  native('S',  '0',                'SZR', var='Ty_S'),
+  native('I1', 'TY_NATIVE_SIGNED', 'SZ1', var='Ty_I1'),
+  native('I2', 'TY_NATIVE_SIGNED', 'SZ2', var='Ty_I2'),
+  native('I4', 'TY_NATIVE_SIGNED', 'SZ4', var='Ty_I4'),
+  native('SI', 'TY_NATIVE_SIGNED', 'SZR', var='Ty_SI'),
+  native('Chan', '0',              'SZR', var='Ty_Chan'),
+
+  fn('baseCompFn',    '0',             'baseCompFn', var='TyFn_baseCompFn'),
+  fn('stk',           'TY_FN_SYN',     'N_stk'),
+  fn('inp',           'TY_FN_SYN',     'N_inp'),
+  fn('memclr',        '0',             'N_memclr', '&TyIs_rU1_U4', var='TyFn_memclr'),
+  fn('\\',            'TY_FN_COMMENT', 'N_fslash'),
+  fn('_',             'TY_FN_SYN',     'N_noop'),
+  fn(';',             'TY_FN_SYN',     'N_noop'),
+  fn(',',             'TY_FN_SYN',     'N_noop'),
+  fn('->',            'TY_FN_SYN',     'N_noop'),
+  fn('notImm',        'TY_FN_SYN',     'N_notImm'),
+  fn('unty',          'TY_FN_SYN',     'N_unty'),
+  fn('ret',           'TY_FN_SYN',     'N_ret'),
+  fn('imm',           'TY_FN_SYN',     'N_imm'),
+  fn('(',             'TY_FN_SYN',     'N_paren'),
+  fn('mod',           'TY_FN_SYN',     'N_mod'),
+  fn('loc',           'TY_FN_SYN',     'N_loc'),
+  fn('fileloc',       'TY_FN_SYN',     'N_fileloc'),
+  fn('fn',            'TY_FN_SYN',     'N_fn'),
+  fn('inline',        'TY_FN_SYN',     'N_inline'),
+  fn('meth',          'TY_FN_SYN',     'N_meth'),
+  fn('fnTy',          'TY_FN_SYN',     'N_fnTy'),
+  fn('var',           'TY_FN_SYN',     'N_var'),
+  fn('if',            'TY_FN_SYN',     'N_if'),
+  fn('match',         'TY_FN_SYN',     'N_match'),
+  fn('cont',          'TY_FN_SYN',     'N_cont'),
+  fn('brk',           'TY_FN_SYN',     'N_brk'),
+  fn('blk',           'TY_FN_SYN',     'N_blk'),
+  fn('struct',        'TY_FN_SYN',     'N_struct'),
+  fn('.',             'TY_FN_SYN',     'N_dot'),
+  fn('&',             'TY_FN_SYN',     'N_amp'),
+  fn('@',             'TY_FN_SYN',     'N_at'),
+  fn('ptrAdd',        'TY_FN_SYN',     'N_ptrAdd'),
+  fn('destruct',      'TY_FN_SYN',     'N_destruct'),
+  fn('spawn',         'TY_FN_SYN',     'N_spawn'),
+  fn('join',          'TY_FN_SYN',     'N_join'),
+  fn('chan',          '0',             'N_chan', '&TyIs_S', '&TyIs_Chan'),
+  fn('chanSpsc',      '0',             'N_chanSpsc', '&TyIs_S', '&TyIs_Chan'),
+  fn('chanFree',      '0',             'N_chanFree', '&TyIs_Chan'),
+  fn('send',          'TY_FN_SYN',     'N_send'),
+  fn('recv',          'TY_FN_SYN',     'N_recv'),
+  fn('fiber',         '0',             'N_fiber', 'TYI_VOID', '&TyIs_S'),
+  fn('setFuel',       '0',             'N_setFuel', '&TyIs_SSS', cond='FNGI_FUEL'),
+  fn('fuel',          '0',             'N_fuel', '&TyIs_S', '&TyIs_S', cond='FNGI_FUEL'),
+  fn('fuelUsed',      '0',             'N_fuelUsed', '&TyIs_S', '&TyIs_S', cond='FNGI_FUEL'),
+  fn('dbgRs',         '0',             'N_dbgRs'),
+  fn('tAssertEq',     '0',             'N_tAssertEq', '&TyIs_SS'),
+  fn('assertWsEmpty', '0',             'N_assertWsEmpty'),
+  fn('setFnTy',       'TY_FN_SYN',     'N_setFnTy'),
+
+  # Stack operators. These are **not** PRE since they directly modify the stack.
+  inline('swp',  '&TyIs_SS', '&TyIs_SS',  'SWP'),
+  inline('drp',  '&TyIs_S',  'TYI_VOID',  'DRP'),
+  inline('ovr',  '&TyIs_SS', '&TyIs_SSS', 'OVR'),
+  inline('dup',  '&TyIs_S',  '&TyIs_SS',  'DUP'),
+  inline('dupn', '&TyIs_S',  '&TyIs_SS',  'DUPN'),
+
+  # Switch to the next ready fiber, see yield.
+  inline('yld',  'TYI_VOID', 'TYI_VOID',  'YLD'),
+
+  # Standard operators that use PRE syntax. Either "a <op> b" or simply "<op> b"
+  inline('nop',   '&TyIs_S',  '&TyIs_S', 'NOP'),
+  inline('inc',   '&TyIs_S',  '&TyIs_S', 'INC'),
+  inline('inc2',  '&TyIs_S',  '&TyIs_S', 'INC2'),
+  inline('inc4',  '&TyIs_S',  '&TyIs_S', 'INC4'),
+  inline('dec',   '&TyIs_S',  '&TyIs_S', 'DEC'),
+  inline('inv',   '&TyIs_S',  '&TyIs_S', 'INV'),
+  inline('neg',   '&TyIs_S',  '&TyIs_S', 'NEG'),
+  inline('not',   '&TyIs_S',  '&TyIs_S', 'NOT'),
+  inline('i1to4', '&TyIs_S',  '&TyIs_S', 'CI1'),
+  inline('i2to4', '&TyIs_S',  '&TyIs_S', 'CI2'),
+  inline('+',     '&TyIs_SS', '&TyIs_S', 'ADD'),
+  inline('-',     '&TyIs_SS', '&TyIs_S', 'SUB'),
+  inline('%',     '&TyIs_SS', '&TyIs_S', 'MOD'),
+  inline('shl',   '&TyIs_SS', '&TyIs_S', 'SHL'),
+  inline('shr',   '&TyIs_SS', '&TyIs_S', 'SHR'),
+  inline('msk',   '&TyIs_SS', '&TyIs_S', 'MSK'),
+  inline('jn',    '&TyIs_SS', '&TyIs_S', 'JN'),
+  inline('xor',   '&TyIs_SS', '&TyIs_S', 'XOR'),
+  inline('and',   '&TyIs_SS', '&TyIs_S', 'AND'),
+  inline('or',    '&TyIs_SS', '&TyIs_S', 'OR'),
+  inline('==',    '&TyIs_SS', '&TyIs_S', 'EQ'),
+  inline('!=',    '&TyIs_SS', '&TyIs_S', 'NEQ'),
+  inline('>=',    '&TyIs_SS', '&TyIs_S', 'GE_U'),
+  inline('<',     '&TyIs_SS', '&TyIs_S', 'LT_U'),
+  inline('ge_s',  '&TyIs_SS', '&TyIs_S', 'GE_S'),
+  inline('lt_s',  '&TyIs_SS', '&TyIs_S', 'LT_S'),
+  inline('*',     '&TyIs_SS', '&TyIs_S', 'MUL'),
+  inline('/',     '&TyIs_SS', '&TyIs_S', 'DIV_U'),
+
+  inline('ft1',   '&TyIs_S', '&TyIs_S', 'SZ1+FT'),
+  inline('ft2',   '&TyIs_S', '&TyIs_S', 'SZ2+FT'),
+  inline('ft4',   '&TyIs_S', '&TyIs_S', 'SZ4+FT'),
+  inline('ftR',   '&TyIs_S', '&TyIs_S', 'SZR+FT'),
+  inline('ftBe1', '&TyIs_S', '&TyIs_S', 'SZ1+FTBE'),
+  inline('ftBe2', '&TyIs_S', '&TyIs_S', 'SZ2+FTBE'),
+  inline('ftBe4', '&TyIs_S', '&TyIs_S', 'SZ4+FTBE'),
+  inline('ftBeR', '&TyIs_S', '&TyIs_S', 'SZR+FTBE'),
+]
+
+comp = [
+  fn('single',     '0', 'N_single',     '&TyIs_S'),
+  fn('compileLit', '0', 'N_compileLit', '&TyIs_SS'),
+  fn('compileTy',  '0', 'N_compileTy',  '&TyIs_UNSET', '&TyIs_UNSET'),
+  fn('findTy',     '0', 'N_findTy',     '&TyIs_UNSET', '&TyIs_UNSET'),
+  fn('setOpt',     '0', 'N_setOpt',     '&TyIs_S'),
+  fn('fnStats',    'TY_FN_SYN', 'N_fnStats', cond='FNGI_STATS'),
+]
+
+compB = B('comp', 'TyDict', 'TY_DICT | TY_DICT_MOD | TY_DICT_BUILTIN', [])
+builtins.append(compB)
+dicts = [('Ty_builtins', builtins), ('bi_comp', comp)]
+
+def nameHash(name):
+  h = 0x811C9DC5
+  for c in name: h = ((h ^ c) * 0x01000193) & 0xFFFFFFFF
+  return h
+
+def cStr(name):
+  s = ''.join(chr(c) if chr(c).isalnum() or c in b'_ ' else f'\\{c:03o}' for c in name)
+  return f'(CStr*)("\\x{len(name):02X}" "{s}")'
+
+def balance(bs):
+  if not bs: return None
+  m = len(bs) // 2
+  bs[m].l = balance(bs[:m]); bs[m].r = balance(bs[m+1:])
+  return bs[m]
+
+def bstAdd(root, b): # add conditional entries as leaves
+  while True:
+    side = 'l' if b.name < root.name else 'r'
+    if getattr(root, side) is None: return setattr(root, side, b)
+    root = getattr(root, side)
+
+def ifdef(f, cond, lines):
+  if cond: f.write(f'#ifdef {cond}\n')
+  for l in lines: f.write(l)
+  if cond: f.write('#endif\n')
+
+allB = [b for (_, bs) in dicts for b in bs]
+assert len({b.name for b in allB}) == len(allB), 'builtin names must be unique'
+for i, b in enumerate(allB):
+  b.var = b.var or ('bi_' + (b.name.decode() if b.name.isalnum() else str(i)))
+roots = {}
+for (var, bs) in dicts:
+  roots[var] = balance(sorted([b for b in bs if not b.cond], key=lambda b: b.name))
+  for b in bs:
+    if b.cond: bstAdd(roots[var], b)
+compB.fields = [('children', f'(Ty*)&{roots["bi_comp"].var}')]
+
+syms = [None] * BUILTIN_TBL
+for b in sorted(allB, key=lambda b: b.cond or ''): # conditional entries last
+  i = nameHash(b.name)
+  while syms[i % BUILTIN_TBL]: i += 1
+  syms[i % BUILTIN_TBL] = b
+owner = {id(b): var for (var, bs) in dicts for b in bs}
+
+with open('gen/builtins.inc', 'w') as f:
+  f.write('/* Custom generated by etc/gen.py */\n')
+  f.write('// Must be included in fngi.c after the native fns, see Kern_init\n\n')
+  f.write(f'#if BUILTIN_TBL != {BUILTIN_TBL}\n#error "BUILTIN_TBL differs from etc/gen.py"\n#endif\n\n')
+  for b in allB:
+    static = 'static ' if b.var.startswith('bi_') else ''
+    ifdef(f, b.cond, [f'{static}{b.ty} {b.var};\n'])
+  for b in allB:
+    if b.ty == 'TyFn' and b.code is not None:
+      f.write(f'static U1 {b.var}_code[] = {{ {b.code} }};\n')
+  for (_, bs) in dicts:
+    f.write('\n')
+    for b in bs:
+      lines = [f'{"static " if b.var.startswith("bi_") else ""}{b.ty} {b.var} = {{\n',
+               f'  .bst.key = {cStr(b.name)},\n']
+      for side in ('l', 'r'):
+        c = getattr(b, side)
+        if not c: continue
+        if c.cond: lines.append(f'#ifdef {c.cond}\n')
+        lines.append(f'  .bst.{side} = (CBst*)&{c.var},\n')
+        if c.cond: lines.append('#endif\n')
+      lines.append(f'  .meta = {b.meta},\n')
+      fields = b.fields
+      if b.code is not None: fields = [('code', f'{b.var}_code')] + fields
+      for (fl, v) in fields: lines.append(f'  .{fl} = {v},\n')
+      lines.append('};\n')
+      ifdef(f, b.cond, lines)
+  f.write('\nTyDict Ty_builtins = {\n')
+  f.write(f'  .bst.key = {cStr(b"builtins")},\n')
+  f.write('  .meta = TY_DICT | TY_DICT_MOD | TY_DICT_BUILTIN,\n')
+  f.write(f'  .children = (Ty*)&{roots["Ty_builtins"].var},\n}};\n\n')
+  f.write('const Sym builtinSyms[BUILTIN_TBL] = {\n')
+  for i, b in enumerate(syms):
+    if b: ifdef(f, b.cond, [f'  [0x{i:02X}] = {{ &{owner[id(b)]}, (Ty*)&{b.var} }},\n'])
+  f.write('};\n')
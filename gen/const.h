@@ -41,6 +41,7 @@
 #define TY_DICT_BITMAP        0x02
 #define TY_DICT_STRUCT        0x03
 #define TY_DICT_ENUM          0x04
+#define TY_DICT_BUILTIN       0x10
 #define TY_NATIVE_SIGNED      0x08
 #define TY_REFS               0x03
 
@@ -20,6 +20,8 @@ Slc instrName(U1 instr) {
     case RG              : return Slc_ntLit("RG");
     case LR              : return Slc_ntLit("LR");
     case GR              : return Slc_ntLit("GR");
+    case LRCLR           : return Slc_ntLit("LRCLR");
+    case ADDLL           : return Slc_ntLit("ADDLL");
     case IEND            : return Slc_ntLit("IEND");
     case INC             : return Slc_ntLit("INC");
     case INC2            : return Slc_ntLit("INC2");
@@ -30,6 +32,7 @@ Slc instrName(U1 instr) {
     case NOT             : return Slc_ntLit("NOT");
     case CI1             : return Slc_ntLit("CI1");
     case CI2             : return Slc_ntLit("CI2");
+    case ADDI            : return Slc_ntLit("ADDI");
     case ADD             : return Slc_ntLit("ADD");
     case SUB             : return Slc_ntLit("SUB");
     case MOD             : return Slc_ntLit("MOD");
@@ -82,6 +85,12 @@ Slc instrName(U1 instr) {
     case LIT + SZ1       : return Slc_ntLit("LIT1");
     case LIT + SZ2       : return Slc_ntLit("LIT2");
     case LIT + SZ4       : return Slc_ntLit("LIT4");
+    case FTLO + SZ1      : return Slc_ntLit("FTLO1");
+    case FTLO + SZ2      : return Slc_ntLit("FTLO2");
+    case FTLO + SZ4      : return Slc_ntLit("FTLO4");
+    case SRFTLL + SZ1    : return Slc_ntLit("SRFTLL1");
+    case SRFTLL + SZ2    : return Slc_ntLit("SRFTLL2");
+    case SRFTLL + SZ4    : return Slc_ntLit("SRFTLL4");
     case LCL             : return Slc_ntLit("LCL");
     case XL              : return Slc_ntLit("XL");
     case JL + SZ1        : return Slc_ntLit("JL1");
@@ -96,9 +105,16 @@ Slc instrName(U1 instr) {
     case SLIC + SZ1      : return Slc_ntLit("SLIC1");
     case SLIC + SZ2      : return Slc_ntLit("SLIC2");
     case SLIC + SZ4      : return Slc_ntLit("SLIC4");
+    case JLZK + SZ1      : return Slc_ntLit("JLZK1");
+    case JLZK + SZ2      : return Slc_ntLit("JLZK2");
+    case JLZK + SZ4      : return Slc_ntLit("JLZK4");
+    case JNE + SZ1       : return Slc_ntLit("JNE1");
+    case JNE + SZ2       : return Slc_ntLit("JNE2");
+    case JNE + SZ4       : return Slc_ntLit("JNE4");
     case JW              : return Slc_ntLit("JW");
     case XLL             : return Slc_ntLit("XLL");
     case XRL             : return Slc_ntLit("XRL");
+    case XLT             : return Slc_ntLit("XLT");
     case SLIT + 0x0      : return Slc_ntLit("{0x00}");
     case SLIT + 0x1      : return Slc_ntLit("{0x01}");
     case SLIT + 0x2      : return Slc_ntLit("{0x02}");
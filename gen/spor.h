@@ -19,6 +19,8 @@
 #define RG                    0x0A
 #define LR                    0x0B
 #define GR                    0x0C
+#define LRCLR                 0x0D
+#define ADDLL                 0x0E
 #define IEND                  0x0F
 #define INC                   0x10
 #define INC2                  0x11
@@ -29,6 +31,7 @@
 #define NOT                   0x16
 #define CI1                   0x17
 #define CI2                   0x18
+#define ADDI                  0x19
 #define ADD                   0x20
 #define SUB                   0x21
 #define MOD                   0x22
@@ -63,14 +66,19 @@
 #define SRGL                  0x48
 #define SRLL                  0x49
 #define LIT                   0x4A
+#define FTLO                  0x4B
+#define SRFTLL                0x4C
 #define LCL                   0x80
 #define XL                    0x81
 #define JW                    0x90
 #define XLL                   0x91
 #define XRL                   0xA0
+#define XLT                   0xA1
 #define JL                    0x82
 #define JLZ                   0x83
 #define JTBL                  0x84
 #define SLIC                  0x85
+#define JLZK                  0x86
+#define JNE                   0x87
 #define SLIT                  0xC0
 
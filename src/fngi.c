@@ -9,6 +9,7 @@
 // * 5: Compiler
 //   * lit / compileLit
 //   * Buffer (op1, op2)
+//   * optimizer
 //   * scan / scanTy
 //   * srOffset
 //   * ftOffset
@@ -32,7 +33,19 @@
 
 #define NL eprintf("\n")
 
-/*extern*/ Kern* fngiK = NULL;
+/*extern*/ FNGI_TLS Kern* fngiK = NULL;
+
+#ifdef FNGI_MT
+/*extern*/ FNGI_TLS jmp_buf* fngiErrJmp = NULL;
+// The thread's innermost executeLoop or REPL, else civ's (i.e. a test's).
+static jmp_buf* errJmp() { return fngiErrJmp ? fngiErrJmp : civ.fb->errJmp; }
+void fngiPanic(Slc err) {
+  if(not ERR_EXPECTED) eprintf("!! ERR: %.*s\n", Dat_fmt(err));
+  longjmp(*errJmp(), 1);
+}
+#else
+#define errJmp()  civ.fb->errJmp
+#endif
 
 void N_dbgRs(Kern* k);
 void dbgWs(Kern *k) {
@@ -55,6 +68,7 @@ void dbgWs(Kern *k) {
 
 TyDict* DictStk_pop(DictStk* stk) {
   ASSERT(stk->sp < stk->cap, "DictStk underflow");
+  stk->gen += 1;
   return stk->dat[stk->sp ++];
 }
 
@@ -65,53 +79,88 @@ TyDict* DictStk_top(DictStk* stk) {
 
 void DictStk_add(DictStk* stk, TyDict* r) {
   ASSERT(stk->sp, "DictStk overflow");
+  stk->gen += 1;
   stk->dat[-- stk->sp] = r;
 }
 
+// Tbl
+
+static inline U4 Tbl_cap(Tbl* t) { return t->blkLen * (BLOCK_SIZE / t->sz); }
 
-bool FnFiber_init(FnFiber* fb) {
-  U4* dat = (U4*) BA_alloc(&civ.ba);
+// Get entry i (mod cap, which is a power of 2).
+static inline U1* Tbl_at(Tbl* t, U4 i) {
+  U4 per = BLOCK_SIZE / t->sz; i &= Tbl_cap(t) - 1;
+  return t->blk[i / per] + (i % per) * t->sz;
+}
+
+// Make room for one more entry: past 3/4 full t doubles (from one block) and
+// its entries are re-inserted at their hash.
+static void Tbl_reserve(Kern* k, Tbl* t, U4(*hash)(U1* e)) {
+  if(4 * (t->len + 1) <= 3 * Tbl_cap(t)) return;
+  Tbl n = { .sz = t->sz, .len = t->len };
+  U1 blkLen = t->blkLen ? 2 * t->blkLen : 1;
+  ASSERT(blkLen <= TBL_BLOCKS, "Tbl full");
+  for(; n.blkLen < blkLen; n.blkLen++) {
+    U1* b = BA_alloc(k->ba); ASSERT(b, "Tbl OOM");
+    memset(b, 0, BLOCK_SIZE); n.blk[n.blkLen] = b;
+  }
+  for(U4 i = 0; i < Tbl_cap(t); i++) {
+    U1* e = Tbl_at(t, i); if(not *(void**)e) continue;
+    U4 h = hash(e); while(*(void**)Tbl_at(&n, h)) h++;
+    memcpy(Tbl_at(&n, h), e, t->sz);
+  }
+  for(U1 b = 0; b < t->blkLen; b++) BA_free(k->ba, t->blk[b]);
+  *t = n;
+}
+
+bool FnFiber_init(FnFiber* fb) { return FnFiber_initBA(fb, &civ.ba); }
+bool FnFiber_initBA(FnFiber* fb, BA* ba) {
+  U4* dat = (U4*) BA_alloc(ba);
   if(not dat) return false;
   fb->ws   = Stk_init(dat, WS_DEPTH); dat += WS_DEPTH;
   fb->info = Stk_init(dat, RS_DEPTH); dat += RS_DEPTH;
   fb->rs   = Stk_init(dat, (BLOCK_SIZE / RSIZE) - WS_DEPTH - RS_DEPTH);
+#ifdef FNGI_FUEL
+  FnFiber_setFuel(fb, FUEL_INF, 0);
+#endif
   return true;
 }
 
 void baseCompFn(Kern* k);
-TyFn TyFn_baseCompFn = {
-  .bst.key = (CStr*) ("\x0A" "baseCompFn"),
-  .meta = TY_FN | TY_FN_NATIVE,
-  .code = (U1*)baseCompFn,
-};
+TyFn TyFn_baseCompFn; // builtin, see gen/builtins.inc
 
-void TyDb_init(TyDb* db) {
-  db->tyIs = Stk_init(db->tyIsDat, TYDB_DEPTH);
-  db->done = Stk_init(db->doneDat, TYDB_DEPTH);
-}
+void TyDb_init(TyDb* db, BBA* bba) { *db = (TyDb) { .bba = bba }; }
 
 void DictStk_reset(Kern* k) {
   k->g.dictStk.sp = k->g.dictStk.cap;
+  DictStk_add(&k->g.dictStk, &Ty_builtins);
   DictStk_add(&k->g.dictStk, &k->g.rootDict);
 }
 
-void Kern_init(Kern* k, FnFiber* fb) {
+void Kern_init(Kern* k, FnFiber* fb) { Kern_initBA(k, &civ.ba, fb); }
+void Kern_initBA(Kern* k, BA* ba, FnFiber* fb) {
   *k = (Kern) {
-    .bbaCode = (BBA) { &civ.ba },
-    .bbaDict = (BBA) { &civ.ba },
-    .bbaRepl = (BBA) { &civ.ba },
+    .ba = ba,
+    .bbaCode = (BBA) { ba },
+    .bbaDict = (BBA) { ba },
+    .bbaRepl = (BBA) { ba },
     .fb = fb,
+    .fibers = { .sz = sizeof(FnFiber*) },
     .g = {
       .compFn = &TyFn_baseCompFn,
       .dictStk = (DictStk) { .dat = k->g.dictBuf, .sp = DICT_DEPTH, .cap = DICT_DEPTH },
       .token = (Buf){.dat = k->g.tokenDat, .cap = 64},
       .bbaDict = &k->bbaDict,
-      .bbaTyImm = (BBA) { &civ.ba },
+      .names = { .sz = sizeof(CStr*) }, .syms = { .sz = sizeof(Sym) },
+      .tyIIntern = { .sz = sizeof(TyI*) },
     },
   };
-  TyDb_init(&k->g.tyDb); TyDb_init(&k->g.tyDbImm);
-  k->g.tyDbImm.bba = &k->g.bbaTyImm;
+  if(fb) fb->kern = k;
+  TyDb_init(&k->g.tyDb, k->g.bbaDict); TyDb_init(&k->g.tyDbImm, k->g.bbaDict);
   DictStk_reset(k);
+#if defined(FNGI_XCACHE) && defined(FNGI_THREADED)
+  xcInit();
+#endif
 }
 
 bool Kern_eof(Kern* k) { return BaseFile_eof(SpReader_asBase(k, k->g.src)); }
@@ -123,7 +172,7 @@ Slc tokenSlc(Kern* k) {
 
 CStr* tokenCStr(Kern* k) {
   scan(k);
-  CStr* out = CStr_new(BBA_asArena(k->g.bbaDict), *Buf_asSlc(&k->g.token));
+  CStr* out = Kern_intern(k, *Buf_asSlc(&k->g.token), NULL);
   tokenDrop(k);
   return out;
 }
@@ -175,25 +224,298 @@ Ty* Ty_new(Kern* k, U2 meta, CStr* key) {
 //   return (U1*)b + b->bot;
 // }
 
+static inline S szIToSz(U1 szI) {
+  switch(SZ_MASK & szI) {
+    case SZ1: return 1;
+    case SZ2: return 2;
+    case SZ4: return 4;
+  }
+  assert(false);
+}
+
+static inline S szToSzI(U1 sz) {
+  switch (sz) {
+    case 1: return SZ1;
+    case 2: return SZ2;
+    case 4: return SZ4;
+  }
+  assert(false);
+}
+
 U4 popLit(Kern* k, U1 size) {
   U4 out = ftBE(cfb->ep, size);
   cfb->ep += size;
   return out;
 }
 
+// The size of an instr's literal(s), not including SLIC's inline data or
+// JTBL's table.
+U1 instrLitSz(U1 instr) {
+  if(instr >= SLIT) return 0;
+  switch(instr) {
+    case DV: case RG: case LCL: case ADDI: return 1;
+    case LR: case XLL:                     return 2;
+    case XRL:                              return 3;
+    case XL: case XLT: case LRCLR: case ADDLL: return 4;
+    case GR:                    return 6;
+  }
+  if(instr < 0x40) return 0;
+  switch(~SZ_MASK & instr) {
+    case FTO:  case SRO:  return 1;
+    case FTLL: case SRLL: return 2;
+    case FTLO:            return 3;
+    case SRFTLL:          return 4;
+    case FTGL: case SRGL: return 6;
+    case LIT:  case JL: case JLZ: case JTBL: case SLIC:
+    case JLZK: case JNE:  return szIToSz(instr);
+  }
+  return 0;
+}
+
+static inline bool isMemOp(U1 instr, U1 op) {
+  return (0x40 == (0xC0 & instr)) and (op == (~SZ_MASK & instr));
+}
+
+// Whether instr is a sized jmp (JL/JLZ/JLZK/JNE), see jmpTarget.
+static inline bool isJmp(U1 instr) {
+  U1 base = ~SZ_MASK & instr;
+  return (instr < SLIT) and ((JL == base) or (JLZ == base) or (JLZK == base) or (JNE == base));
+}
+
+// Get the index that the sized jmp (JL/JLZ/etc) at code[i] jumps to.
+I4 jmpTarget(U1* code, I4 i) {
+  U1 sz = szIToSz(code[i]); U4 v = ftBE(code + i + 1, sz);
+  switch(sz) {
+    case 1: return i + 1 + (I1)v;
+    case 2: return i + 1 + (I2)v;
+  }
+  return i + 1 + (I4)v;
+}
+
+// Get the index of the instr after code[i]
+static inline U2 instrNext(U1* code, U2 i) {
+  U1 instr = code[i]; U2 n = i + 1 + instrLitSz(instr);
+  if((~SZ_MASK & instr) == SLIC) n += ftBE(code + i + 1, szIToSz(instr));
+  if((~SZ_MASK & instr) == JTBL) {
+    U1 sz = szIToSz(instr); n += sz * ftBE(code + i + 1, sz);
+  }
+  return n;
+}
+
+// Get the index that entry e of the JTBL at code[i] jumps to.
+I4 jtblTarget(U1* code, I4 i, U4 e) {
+  U1 sz = szIToSz(code[i]); I4 at = i + 1 + sz + e * sz; U4 v = ftBE(code + at, sz);
+  switch(sz) {
+    case 1: return at + (I1)v;
+    case 2: return at + (I2)v;
+  }
+  return at + (I4)v;
+}
+
+// Get the length of the code reachable from code[0], for code which has no
+// len (i.e. from compileRepl or litFn).
+U2 codeExtent(U1* code) {
+  U2 i = 0, end = 1;
+  while(i < end) {
+    U1 instr = code[i], base = ~SZ_MASK & instr;
+    U2 next = instrNext(code, i);
+    if((base == JL) or (base == JLZ) or (base == JLZK) or (base == JNE)) {
+      I4 to = jmpTarget(code, i);
+      if(to >= end) end = to + 1;
+    } else if(base == JTBL) {
+      for(U4 e = 0; e < ftBE(code + i + 1, szIToSz(instr)); e++) {
+        I4 to = jtblTarget(code, i, e);
+        if(to >= end) end = to + 1;
+      }
+    }
+    if((instr != RET) and (base != JL) and (next >= end)) end = next + 1;
+    i = next;
+  }
+  return i;
+}
+
 // Make sure to check isFnNative first!
 static inline void executeNative(Kern* k, TyFn* fn) {
   ((void(*)(Kern*)) fn->code)(k);
 }
 
-void xImpl(Kern* k, Ty* ty) {
-  TyFn* fn = tyFn(ty);
-  if(isFnNative(fn)) return executeNative(k, fn);
+#ifdef FNGI_XCACHE
+//   *******
+//   * 2.b: Translation cache
+// With FNGI_XCACHE, non-native code is translated (on first execution) into
+// an array of XCell {handler, operand}, which is what cfb->ep points into.
+// Jumps become XCell pointers and GR/FTGL/SRGL the final address. JTBL's
+// operand is its len, followed by a cell per entry.
+
+inline static U1 executeInstr(Kern* k);
+// The same in every thread, so shared even with FNGI_MT.
+static const void* const* xcTbl = NULL; // FNGI_THREADED labels
+
+#ifdef FNGI_THREADED
+// The labels only exist inside executeInstr, which exports them when called
+// without a Kern. Kern_initBA calls this before anything is translated.
+void xcInit() { if(not xcTbl) executeInstr(NULL); }
+#endif
+
+static inline S xcHandler(U1 instr) {
+#ifdef FNGI_THREADED
+  return (S)xcTbl[instr];
+#else
+  return instr;
+#endif
+}
+
+static inline U2 xcInstrCells(U1* code, U2 i) { // cells of the instr at i
+  U1 base = ~SZ_MASK & code[i];
+  if(base == SLIC) return 2; // SLIC's len is its own cell
+  if(base == JTBL) return 1 + ftBE(code + i + 1, szIToSz(code[i])); // and its table
+  return 1;
+}
+
+static U2 xcCells(U1* code, U2 len) { // cells of a translation, with IEND
+  U2 n = 1;
+  for(U2 i = 0; i < len; i = instrNext(code, i)) n += xcInstrCells(code, i);
+  return n;
+}
+
+// The translations of redefined fns are kept in k->xcFree ({next, cells} in
+// their first cell) and reused by the next translation which fits.
+static void xcFree(Kern* k, TyFn* fn) {
+  if(not fn->xc) return;
+  *fn->xc = (XCell) { .h = (S)k->xcFree, .a = xcCells(fn->code, fn->len) };
+  k->xcFree = fn->xc; fn->xc = NULL;
+}
+
+static XCell* xcReuse(Kern* k, U2 cells) {
+  for(XCell** p = &k->xcFree; *p; p = (XCell**)&(*p)->h) {
+    XCell* xc = *p;
+    if(xc->a >= cells) { *p = (XCell*)xc->h; return xc; }
+  }
+  return NULL;
+}
+
+XCell* xcTranslate(Kern* k, BBA* bba, U1* code, U2 len) {
+  if(not len) len = codeExtent(code);
+  U2 n = xcCells(code, len) - 1;
+  XCell* xc = (bba == &k->bbaCode) ? xcReuse(k, n + 1) : NULL;
+  if(not xc) xc = (XCell*) BBA_alloc(bba, (n + 1) * sizeof(XCell), RSIZE);
+  ASSERT(xc, "xcache OOM");
+  // code index -> cell, in scratch space freed below
+  U2* cellI = (U2*) BBA_alloc(bba, (len + 1) * sizeof(U2), sizeof(U2));
+  ASSERT(cellI, "xcache OOM");
+  memset(cellI, 0xFF, (len + 1) * sizeof(U2));
+  for(U2 i = 0, c = 0; i < len; i = instrNext(code, i)) {
+    cellI[i] = c; c += xcInstrCells(code, i);
+  }
+  // Dead jmps can target the end, which panics if it is ever executed.
+  cellI[len] = n;
+  xc[n] = (XCell) { .h = xcHandler(IEND) };
+  for(U2 i = 0; i < len; i = instrNext(code, i)) {
+    U1 instr = code[i], base = ~SZ_MASK & instr; U1* lit = code + i + 1;
+    XCell* c = xc + cellI[i];
+    *c = (XCell) { .h = xcHandler(instr) };
+    if(instr >= SLIT) { c->a = 0x3F & instr; continue; }
+    switch(instr) {
+      case LR: case XLL: c->a = ftBE(lit, 2); continue;
+      case XL: case XLT: c->a = ftBE(lit, 4); continue;
+      case XRL:          c->a = ftBE(lit, 2) | (lit[2] << 16); continue;
+      case LRCLR: case ADDLL:
+                         c->a = ftBE(lit, 2) | (ftBE(lit + 2, 2) << 16); continue;
+      case GR:           c->a = ((TyVar*)ftBE(lit, 4))->v + ftBE(lit + 4, 2);
+                         continue;
+    }
+    if(instr < 0x40) { if(instrLitSz(instr)) c->a = *lit; continue; }
+    if(instr < 0x80) switch(base) {
+      case FTGL: case SRGL:
+        c->a = ((TyVar*)ftBE(lit, 4))->v + ftBE(lit + 4, 2); continue;
+      case FTLO:   c->a = ftBE(lit, 2) | (lit[2] << 16); continue;
+      case SRFTLL: c->a = ftBE(lit, 2) | (ftBE(lit + 2, 2) << 16); continue;
+      default: c->a = ftBE(lit, instrLitSz(instr)); continue;
+    }
+    switch(base) {
+      case JL: case JLZ: case JLZK: case JNE: {
+        I4 to = jmpTarget(code, i);
+        ASSERT((to >= 0) and (to <= len) and (cellI[to] != 0xFFFF),
+               "xcache: invalid jmp");
+        c->a = (S)(xc + cellI[to]);
+        continue;
+      }
+      case SLIC: {
+        U1 sz = szIToSz(instr);
+        c->a = (S)(lit + sz); c[1] = (XCell) { .a = ftBE(lit, sz) };
+        continue;
+      }
+      case JTBL: {
+        c->a = ftBE(lit, szIToSz(instr));
+        for(U4 e = 0; e < c->a; e++) {
+          I4 to = jtblTarget(code, i, e);
+          ASSERT((to >= 0) and (to <= len) and (cellI[to] != 0xFFFF),
+                 "xcache: invalid jmp");
+          c[1 + e] = (XCell) { .a = (S)(xc + cellI[to]) };
+        }
+        continue;
+      }
+    }
+  }
+  ASSERT(not BBA_free(bba, cellI, (len + 1) * sizeof(U2), sizeof(U2)),
+         "xcache free");
+  return xc;
+}
+
+// Get the ep to execute fn, translating it if not yet cached.
+static inline U1* fnEp(Kern* k, TyFn* fn) {
+  if(not fn->xc) fn->xc = xcTranslate(k, &k->bbaCode, fn->code, fn->len);
+  return (U1*) fn->xc;
+}
+
+// Get the offset into fn->code of an ep.
+U2 fnEpOffset(TyFn* fn, U1* ep) {
+  if(not fn->xc) return ep - fn->code;
+  U2 cells = (XCell*)ep - fn->xc, i = 0;
+  while(cells and (i < fn->len)) {
+    U2 n = xcInstrCells(fn->code, i);
+    cells -= (n < cells) ? n : cells;
+    i = instrNext(fn->code, i);
+  }
+  return i;
+}
+#else
+#define fnEp(K, FN)         ((FN)->code)
+#define fnEpOffset(FN, EP)  ((EP) - (FN)->code)
+#endif
+
+#ifdef FNGI_JIT
+void* fnJit(Kern* k, TyFn* fn);
+#endif
+
+#ifdef FNGI_STATS
+void statsEnter(Kern* k, TyFn* fn);
+void statsRet(Kern* k);
+void statsSwitch(Kern* k, FnFiber* to);
+#else
+#define statsEnter(K, FN)
+#define statsRet(K)
+#define statsSwitch(K, TO)
+#endif
+
+U1* fnEnter(Kern* k, TyFn* fn) {
   ASSERT(RS->sp >= fn->lSlots + 1, "execute: return stack overflow");
   INFO_ADD((S)fn);
   RS_ADD((S)cfb->ep);
-  cfb->ep = fn->code;
   RS->sp -= fn->lSlots; // grow locals (and possibly defer)
+  statsEnter(k, fn);
+  return (U1*)RS_topRef(k);
+}
+
+void xImpl(Kern* k, Ty* ty) {
+  TyFn* fn = tyFn(ty);
+  if(isFnNative(fn)) return executeNative(k, fn);
+#ifdef FNGI_JIT
+  void* jit = fnJit(k, fn);
+  if(jit) return ((void(*)(Kern*)) jit)(k);
+#endif
+  fnEnter(k, fn);
+  cfb->ep = fnEp(k, fn);
 }
 
 TyFn catchTy = (TyFn) {
@@ -203,134 +525,319 @@ TyFn catchTy = (TyFn) {
 };
 
 void ret(Kern* k) {
+  statsRet(k);
   TyFn* ty = (TyFn*) INFO_POP();
   U1 lSlots = (ty == &catchTy) ? 0 : ty->lSlots;
   RS->sp += lSlots;
   cfb->ep = (U1*)RS_POP();
 }
 
+// XL in tail position (it is followed by RET): replace the current frame with
+// fn's, resizing the locals. Otherwise (native, JIT'd or there is no frame of
+// our own) this is a normal call which returns to the RET.
+void xltImpl(Kern* k, Ty* ty) {
+  TyFn* fn = tyFn(ty);
+  TyFn* cur = Stk_len(&cfb->info) ? (TyFn*) Stk_top(&cfb->info) : &catchTy;
+  if(isFnNative(fn) or (cur == &catchTy)) return xImpl(k, ty);
+#ifdef FNGI_JIT
+  if(fnJit(k, fn)) return xImpl(k, ty);
+#endif
+  statsRet(k);
+  RS->sp += cur->lSlots;
+  ASSERT(RS->sp >= fn->lSlots, "execute: return stack overflow");
+  *Stk_topRef(&cfb->info) = (S)fn;
+  RS->sp -= fn->lSlots;
+  statsEnter(k, fn);
+  cfb->ep = fnEp(k, fn);
+}
+
 void jmpImpl(Kern* k, void* ty) {
   TyFn* fn = tyFn(ty);
   ASSERT(0 == fn->lSlots, "jmp to fn with locals");
-  cfb->ep = fn->code;
+  cfb->ep = fnEp(k, fn);
 }
 
-void slcImpl(Kern* k, U1 sz) {
-  S len = popLit(k, sz);
-  WS_ADD((S)cfb->ep); WS_ADD(len); // {dat, len}
-  cfb->ep += len;
+static inline U1* gRef(Kern* k) { // {&TyVar, U2 offset} literals
+  TyVar* g = (TyVar*) popLit(k, 4);
+  return (U1*)g->v + popLit(k, 2);
 }
 
-inline static U1 executeInstr(Kern* k, U1 instr) {
-  Slc name = instrName(instr);
-  eprintf("!!! instr %0.u: %+10.*s: ", k->fb->ep, Dat_fmt(name)); dbgWs(k); NL;
-  U4 l, r;
-  switch ((U1)instr) {
-    // Operation Cases
-    case NOP: R0
-    case RETZ: if(WS_POP()) { R0 } // intentional fallthrough
-    case RET: return RET;
-    case YLD: return YLD;
-    case SWP: WS_POP2(l, r); WS_ADD2(r, l); R0
-    case DRP : WS_POP(); R0
-    case OVR : WS_POP2(l, r); WS_ADD3(l, r, l);          R0
-    case DUP : r = WS_POP(); WS_ADD2(r, r);              R0
-    case DUPN: r = WS_POP(); WS_ADD(r); WS_ADD(0 == r);  R0
-    case LR: WS_ADD(RS_topRef(k) + popLit(k, 2)); R0
-    case GR: {
-      TyVar* g = (TyVar*) popLit(k, 4);
-      WS_ADD(g->v + popLit(k, 2));
-      return 0;
-    }
-
-    case INC : WS_ADD(WS_POP() + 1); R0
-    case INC2: WS_ADD(WS_POP() + 2); R0
-    case INC4: WS_ADD(WS_POP() + 4); R0
-    case DEC : WS_ADD(WS_POP() - 1); R0
-    case INV : WS_ADD(~WS_POP()); R0
-    case NEG : WS_ADD(-WS_POP()); R0
-    case NOT : WS_ADD(0 == WS_POP()); R0
-    case CI1 : WS_ADD((I4) ((I1) WS_POP())); R0
-    case CI2 : WS_ADD((I4) ((I2) WS_POP())); R0
-
-    case ADD : r = WS_POP(); WS_ADD(WS_POP() + r); R0
-    case SUB : r = WS_POP(); WS_ADD(WS_POP() - r); R0
-    case MOD : r = WS_POP(); WS_ADD(WS_POP() % r); R0
-    case SHL : r = WS_POP(); WS_ADD(WS_POP() << r); R0
-    case SHR : r = WS_POP(); WS_ADD(WS_POP() >> r); R0
-    case MSK : r = WS_POP(); WS_ADD(WS_POP() & r); R0
-    case JN  : r = WS_POP(); WS_ADD(WS_POP() | r); R0
-    case XOR : r = WS_POP(); WS_ADD(WS_POP() ^ r); R0
-    case AND : r = WS_POP(); WS_ADD(WS_POP() && r); R0
-    case OR  : r = WS_POP(); WS_ADD(WS_POP() || r); R0
-    case EQ  : r = WS_POP(); WS_ADD(WS_POP() == r); R0
-    case NEQ : r = WS_POP(); WS_ADD(WS_POP() != r); R0
-    case GE_U: r = WS_POP(); WS_ADD(WS_POP() >= r); R0
-    case LT_U: r = WS_POP(); WS_ADD(WS_POP() < r); R0
-    case GE_S: r = WS_POP(); WS_ADD(((I4)WS_POP()) >= ((I4)r)); R0
-    case LT_S: r = WS_POP(); WS_ADD(((I4)WS_POP()) < ((I4)r)); R0
-    case MUL  :r = WS_POP(); WS_ADD(WS_POP() * r); R0
-    case DIV_U:r = WS_POP(); WS_ADD(WS_POP() / r); R0
-    case DIV_S: WS_POP2(l, r); ASSERT(r, "Div zero");
-                WS_ADD((I4)l / (I4)r);             R0
-
-    // Mem Cases
-    case SZ1 + FT: WS_ADD(*(U1*)WS_POP()); R0
-    case SZ2 + FT: WS_ADD(*(U2*)WS_POP()); R0
-    case SZ4 + FT: WS_ADD(*(U4*)WS_POP()); R0
-
-    case SZ1 + FTBE: WS_ADD(ftBE((U1*)WS_POP(), 1)); R0
-    case SZ2 + FTBE: WS_ADD(ftBE((U1*)WS_POP(), 2)); R0
-    case SZ4 + FTBE: WS_ADD(ftBE((U1*)WS_POP(), 4)); R0
-
-    case SZ1 + FTO: WS_ADD(*(U1*) (WS_POP() + popLit(k, 1))); R0
-    case SZ2 + FTO: WS_ADD(*(U2*) (WS_POP() + popLit(k, 1))); R0
-    case SZ4 + FTO: WS_ADD(*(U4*) (WS_POP() + popLit(k, 1))); R0
-
-    case SZ1 + FTLL: WS_ADD(*(U1*) (RS_topRef(k) + popLit(k, 2))); R0
-    case SZ2 + FTLL: WS_ADD(*(U2*) (RS_topRef(k) + popLit(k, 2))); R0
-    case SZ4 + FTLL: WS_ADD(*(U4*) (RS_topRef(k) + popLit(k, 2))); R0
-
-    case SZ1 + FTGL:
-    case SZ2 + FTGL:
-    case SZ4 + FTGL: {
-      TyVar* g = (TyVar*) popLit(k, 4);
-      WS_ADD(ftSzI((U1*)g->v + popLit(k, 2), SZ_MASK & instr));
-      return 0;
-    }
+#ifdef FNGI_FUEL
+//   *******
+//   * Fuel
+// FUEL() decrements cfb->tick, which is cheap enough for every call and backward
+// jmp. fuelOut accounts for the tickLen units when it reaches 0.
 
-    case SZ1 + SRGL:
-    case SZ2 + SRGL:
-    case SZ4 + SRGL: {
-      TyVar* g = (TyVar*) popLit(k, 4);
-      srSzI((U1*)g->v + popLit(k, 2), SZ_MASK & instr, WS_POP());
-      return 0;
-    }
+static void fuelReload(FnFiber* fb) {
+  fb->tickLen = (fb->slice and (fb->slice < fb->fuel)) ? fb->slice : fb->fuel;
+  fb->tick = fb->tickLen;
+}
 
-    case SZ1 + SR: WS_POP2(l, r); *(U1*)l = r; R0
-    case SZ2 + SR: WS_POP2(l, r); *(U2*)l = r; R0
-    case SZ4 + SR: WS_POP2(l, r); *(U4*)l = r; R0
+static void fuelFold(FnFiber* fb) { // account for the units used so far
+  U4 n = fb->tickLen - fb->tick; fb->used += n;
+  if(FUEL_INF != fb->fuel) fb->fuel -= n;
+}
 
-    case SZ1 + SRBE: WS_POP2(l, r); srBE((U1*)l, 1, r); R0
-    case SZ2 + SRBE: WS_POP2(l, r); srBE((U1*)l, 2, r); R0
-    case SZ4 + SRBE: WS_POP2(l, r); srBE((U1*)l, 4, r); R0
+void FnFiber_setFuel(FnFiber* fb, U4 fuel, U4 slice) {
+  if(fb->tickLen) fuelFold(fb);
+  ASSERT(fuel, "fuel must be > 0");
+  fb->fuel = fuel; fb->slice = slice;
+  fuelReload(fb);
+}
 
-    case SZ1 + SRO: WS_POP2(l, r); *(U1*)(l + popLit(k, 1)) = r; R0
-    case SZ2 + SRO: WS_POP2(l, r); *(U2*)(l + popLit(k, 1)) = r; R0
-    case SZ4 + SRO: WS_POP2(l, r); *(U4*)(l + popLit(k, 1)) = r; R0
+U4 FnFiber_fuel(FnFiber* fb) {
+  return (FUEL_INF == fb->fuel) ? FUEL_INF : fb->fuel - (fb->tickLen - fb->tick);
+}
+U4 FnFiber_fuelUsed(FnFiber* fb) { return fb->used + (fb->tickLen - fb->tick); }
 
-    case SZ1 + SRLL: *(U1*) (RS_topRef(k) + popLit(k, 2)) = WS_POP(); R0
-    case SZ2 + SRLL: *(U2*) (RS_topRef(k) + popLit(k, 2)) = WS_POP(); R0
-    case SZ4 + SRLL: *(U4*) (RS_topRef(k) + popLit(k, 2)) = WS_POP(); R0
+// cfb->tick reached 0: panic if out of fuel, else return whether to yield.
+static bool fuelOut(Kern* k) {
+  FnFiber* fb = cfb; fuelFold(fb);
+  if(not fb->fuel) {
+    fb->fuel = FUEL_INF; fuelReload(fb);
+    SET_ERR(SLC("out of fuel"));
+  }
+  fuelReload(fb);
+  return fb->slice;
+}
+#define FUEL()  do { if(not --cfb->tick) { SPILL(); if(fuelOut(k)) return YLD; } } while(0)
+#define JMP(TO) do { U1* _to = (TO); bool _back = _to < cfb->ep; \
+    cfb->ep = _to; if(_back) FUEL(); } while(0)
+#else
+#define FUEL()
+#define JMP(TO) (cfb->ep = (TO))
+#endif
+
+// executeInstr has two dispatch engines which share the instruction bodies:
+// * default: a switch which executes a single instr per call from executeLoop.
+// * FNGI_THREADED: computed goto (GCC labels-as-values) through the table in
+//   gen/instrTbl.inc. Each instr jumps directly to the next one and only
+//   returns to executeLoop for YLD or the fiber's final RET.
+// With FNGI_XCACHE both execute XCells (see 2.b) instead of decoding bytes.
+// With FNGI_TOS the top of WS is cached in the local 'tos' (when 'tosOk') for
+// the whole threaded execution, and is spilled to WS before anything else can
+// observe WS (calls, YLD/RET and errors).
+#ifdef FNGI_XCACHE
+#define FETCH()           (xc = (XCell*)cfb->ep, cfb->ep += sizeof(XCell), xc->h)
+#define LITV(SZ)          (xc->a)
+#define SLIT_V            (xc->a)
+#define GREF()            ((U1*)xc->a)
+#define JMP_TO(SZ, ISZ)   ((U1*)xc->a)
+#define JTBL_TO(SZ, ISZ)  (r = POP(), \
+    (r < xc->a) ? (U1*)xc[1 + r].a : cfb->ep + xc->a * sizeof(XCell))
+#define LIT_LO(SZ)        (0xFFFF & xc->a)
+#define LIT_HI(SZ)        (xc->a >> 16)
+#define INLINE_SLC(SZ)    do { PUSH2(xc->a, xc[1].a); cfb->ep += sizeof(XCell); } while(0)
+#ifdef FNGI_TRACE
+#define TRACE_INSTR()     do { \
+    eprintf("!!! xcell %0.u: %+10X: ", xc, xc->h); TRACE_TOS(); dbgWs(k); NL; \
+  } while(0)
+#endif
+#else
+#define FETCH()           popLit(k, 1)
+#define LITV(SZ)          popLit(k, SZ)
+#define SLIT_V            (0x3F & instr)
+#define GREF()            gRef(k)
+#define JMP_TO(SZ, ISZ)   (r = popLit(k, SZ), cfb->ep + (ISZ)r - SZ)
+#define JTBL_TO(SZ, ISZ)  (l = popLit(k, SZ), r = POP(), (r < l) \
+    ? cfb->ep + r * SZ + (ISZ)ftBE(cfb->ep + r * SZ, SZ) : cfb->ep + l * SZ)
+#define LIT_LO(SZ)        popLit(k, SZ) /* two literals: must be in order */
+#define LIT_HI(SZ)        popLit(k, SZ)
+#define INLINE_SLC(SZ)    do { /* {dat, len} */ \
+    r = popLit(k, SZ); PUSH2((S)cfb->ep, r); cfb->ep += r; \
+  } while(0)
+#ifdef FNGI_TRACE
+#define TRACE_INSTR()     do { \
+    Slc name = instrName(instr); \
+    eprintf("!!! instr %0.u: %+10.*s: ", k->fb->ep, Dat_fmt(name)); TRACE_TOS(); dbgWs(k); NL; \
+  } while(0)
+#endif
+#endif
+#ifndef FNGI_TRACE
+#define TRACE_INSTR()
+#endif
+
+#ifdef FNGI_HIST // SLITs are counted as SLIT
+/*extern*/ FNGI_TLS U8 histOps[0x100]; /*extern*/ FNGI_TLS U8 histPairs[0x100][0x100];
+static FNGI_TLS U1 histPrev = NOP;
+#define HIST_INSTR()      do { U1 _i = ((U1)instr >= SLIT) ? SLIT : instr; \
+    histOps[_i] += 1; histPairs[histPrev][_i] += 1; histPrev = _i; \
+  } while(0)
+#else
+#define HIST_INSTR()
+#endif
+
+#ifdef FNGI_THREADED
+#ifdef FNGI_XCACHE
+#define DISPATCH()        goto *(void*)instr
+#else
+#define DISPATCH()        goto *instrTbl[instr]
+#endif
+#define OP(NAME, INSTR)   I_##NAME:
+#define NEXT              do { instr = FETCH(); HIST_INSTR(); TRACE_INSTR(); DISPATCH(); } while(0)
+#else
+#define OP(NAME, INSTR)   case INSTR:
+#define NEXT              return 0
+#endif
+
+#ifdef FNGI_TOS
+// The WS depth (including tos) is checked exactly like Stk_add/Stk_pop.
+#define POP()             (tosOk ? (tosOk = false, tos) : Stk_pop(WS))
+#define PUSH(V)           do { S _v = (V); \
+    PANIC_IF(WS->sp <= tosOk, "Stk overflow"); \
+    if(tosOk) WS->dat[--WS->sp] = tos; \
+    tos = _v; tosOk = true; \
+  } while(0)
+#define TOP()             (tosOk ? tos : Stk_top(WS))
+#define SPILL()           do { if(tosOk) { WS->dat[--WS->sp] = tos; tosOk = false; } } while(0)
+#define TRACE_TOS()       do { if(tosOk) eprintf("{tos=%X} ", tos); } while(0)
+#else
+#define POP()             WS_POP()
+#define PUSH(V)           WS_ADD(V)
+#define TOP()             Stk_top(WS)
+#define SPILL()
+#define TRACE_TOS()
+#endif
+// Panics spill tos first, so catchPanic and the dumps see all of WS.
+#define PANIC_IF(C, E)    do { if(C) { SPILL(); SET_ERR(SLC(E)); } } while(0)
+#define POP2(A, B)        do { B = POP(); A = POP(); } while(0)
+#define PUSH2(A, B)       do { PUSH(A); PUSH(B); } while(0)
+#define PUSH3(A, B, C)    do { PUSH(A); PUSH(B); PUSH(C); } while(0)
+
+inline static U1 executeInstr(Kern* k) {
+  U4 l, r; S instr;
+#ifdef FNGI_XCACHE
+  XCell* xc;
+#endif
+#ifdef FNGI_TOS
+  S tos; bool tosOk = false;
+#endif
+#ifdef FNGI_THREADED
+  #include "instrTbl.inc"
+#ifdef FNGI_XCACHE
+  if(not k) { xcTbl = instrTbl; return 0; } // see xcInit
+#endif
+  NEXT;
+#else
+  instr = FETCH(); HIST_INSTR(); TRACE_INSTR();
+  switch ((U1)instr) {
+#endif
+    // Operation Cases
+    OP(NOP, NOP) NEXT;
+    OP(RETZ, RETZ) if(POP()) { NEXT; } // intentional fallthrough
+    OP(RET, RET)
+#ifdef FNGI_THREADED
+      if(Stk_len(RS)) { ret(k); NEXT; } // executeLoop only sees the fiber end
+#endif
+      SPILL(); return RET;
+    OP(YLD, YLD) SPILL(); return YLD;
+    OP(SWP, SWP) POP2(l, r); PUSH2(r, l); NEXT;
+    OP(DRP, DRP) POP(); NEXT;
+    OP(OVR, OVR) POP2(l, r); PUSH3(l, r, l);          NEXT;
+    OP(DUP, DUP) r = POP(); PUSH2(r, r);              NEXT;
+    OP(DUPN, DUPN) r = POP(); PUSH(r); PUSH(0 == r); NEXT;
+    OP(LR, LR) PUSH(RS_topRef(k) + LITV(2)); NEXT;
+    OP(GR, GR) PUSH((S)GREF()); NEXT;
+    OP(LRCLR, LRCLR) l = LIT_LO(2); r = LIT_HI(2);
+                     memset((U1*)RS_topRef(k) + l, 0, r); NEXT;
+    OP(ADDLL, ADDLL) l = LIT_LO(2); r = LIT_HI(2);
+                     PUSH(*(U4*)(RS_topRef(k) + l) + *(U4*)(RS_topRef(k) + r)); NEXT;
+
+    OP(INC, INC)   PUSH(POP() + 1); NEXT;
+    OP(INC2, INC2) PUSH(POP() + 2); NEXT;
+    OP(INC4, INC4) PUSH(POP() + 4); NEXT;
+    OP(DEC, DEC)   PUSH(POP() - 1); NEXT;
+    OP(INV, INV)   PUSH(~POP()); NEXT;
+    OP(NEG, NEG)   PUSH(-POP()); NEXT;
+    OP(NOT, NOT)   PUSH(0 == POP()); NEXT;
+    OP(CI1, CI1)   PUSH((I4) ((I1) POP())); NEXT;
+    OP(CI2, CI2)   PUSH((I4) ((I2) POP())); NEXT;
+    OP(ADDI, ADDI) PUSH(POP() + LITV(1)); NEXT;
+
+    OP(ADD, ADD)   r = POP(); PUSH(POP() + r); NEXT;
+    OP(SUB, SUB)   r = POP(); PUSH(POP() - r); NEXT;
+    OP(MOD, MOD)   r = POP(); PUSH(POP() % r); NEXT;
+    OP(SHL, SHL)   r = POP(); PUSH(POP() << r); NEXT;
+    OP(SHR, SHR)   r = POP(); PUSH(POP() >> r); NEXT;
+    OP(MSK, MSK)   r = POP(); PUSH(POP() & r); NEXT;
+    OP(JN, JN)     r = POP(); PUSH(POP() | r); NEXT;
+    OP(XOR, XOR)   r = POP(); PUSH(POP() ^ r); NEXT;
+    OP(AND, AND)   r = POP(); PUSH(POP() && r); NEXT;
+    OP(OR, OR)     r = POP(); PUSH(POP() || r); NEXT;
+    OP(EQ, EQ)     r = POP(); PUSH(POP() == r); NEXT;
+    OP(NEQ, NEQ)   r = POP(); PUSH(POP() != r); NEXT;
+    OP(GE_U, GE_U) r = POP(); PUSH(POP() >= r); NEXT;
+    OP(LT_U, LT_U) r = POP(); PUSH(POP() < r); NEXT;
+    OP(GE_S, GE_S) r = POP(); PUSH(((I4)POP()) >= ((I4)r)); NEXT;
+    OP(LT_S, LT_S) r = POP(); PUSH(((I4)POP()) < ((I4)r)); NEXT;
+    OP(MUL, MUL)     r = POP(); PUSH(POP() * r); NEXT;
+    OP(DIV_U, DIV_U) r = POP(); PUSH(POP() / r); NEXT;
+    OP(DIV_S, DIV_S) POP2(l, r); PANIC_IF(not r, "Div zero");
+                     PUSH((I4)l / (I4)r);             NEXT;
 
-    case SZ1 + LIT: WS_ADD(popLit(k, 1)); R0
-    case SZ2 + LIT: WS_ADD(popLit(k, 2)); R0
-    case SZ4 + LIT: WS_ADD(popLit(k, 4)); R0
+    // Mem Cases
+    OP(FT1, SZ1 + FT) PUSH(*(U1*)POP()); NEXT;
+    OP(FT2, SZ2 + FT) PUSH(*(U2*)POP()); NEXT;
+    OP(FT4, SZ4 + FT) PUSH(*(U4*)POP()); NEXT;
+
+    OP(FTBE1, SZ1 + FTBE) PUSH(ftBE((U1*)POP(), 1)); NEXT;
+    OP(FTBE2, SZ2 + FTBE) PUSH(ftBE((U1*)POP(), 2)); NEXT;
+    OP(FTBE4, SZ4 + FTBE) PUSH(ftBE((U1*)POP(), 4)); NEXT;
+
+    OP(FTO1, SZ1 + FTO) PUSH(*(U1*) (POP() + LITV(1))); NEXT;
+    OP(FTO2, SZ2 + FTO) PUSH(*(U2*) (POP() + LITV(1))); NEXT;
+    OP(FTO4, SZ4 + FTO) PUSH(*(U4*) (POP() + LITV(1))); NEXT;
+
+    OP(FTLL1, SZ1 + FTLL) PUSH(*(U1*) (RS_topRef(k) + LITV(2))); NEXT;
+    OP(FTLL2, SZ2 + FTLL) PUSH(*(U2*) (RS_topRef(k) + LITV(2))); NEXT;
+    OP(FTLL4, SZ4 + FTLL) PUSH(*(U4*) (RS_topRef(k) + LITV(2))); NEXT;
+
+    OP(FTGL1, SZ1 + FTGL) PUSH(*(U1*)GREF()); NEXT;
+    OP(FTGL2, SZ2 + FTGL) PUSH(*(U2*)GREF()); NEXT;
+    OP(FTGL4, SZ4 + FTGL) PUSH(*(U4*)GREF()); NEXT;
+
+    OP(SRGL1, SZ1 + SRGL) *(U1*)GREF() = POP(); NEXT;
+    OP(SRGL2, SZ2 + SRGL) *(U2*)GREF() = POP(); NEXT;
+    OP(SRGL4, SZ4 + SRGL) *(U4*)GREF() = POP(); NEXT;
+
+    OP(SR1, SZ1 + SR) POP2(l, r); *(U1*)l = r; NEXT;
+    OP(SR2, SZ2 + SR) POP2(l, r); *(U2*)l = r; NEXT;
+    OP(SR4, SZ4 + SR) POP2(l, r); *(U4*)l = r; NEXT;
+
+    OP(SRBE1, SZ1 + SRBE) POP2(l, r); srBE((U1*)l, 1, r); NEXT;
+    OP(SRBE2, SZ2 + SRBE) POP2(l, r); srBE((U1*)l, 2, r); NEXT;
+    OP(SRBE4, SZ4 + SRBE) POP2(l, r); srBE((U1*)l, 4, r); NEXT;
+
+    OP(SRO1, SZ1 + SRO) POP2(l, r); *(U1*)(l + LITV(1)) = r; NEXT;
+    OP(SRO2, SZ2 + SRO) POP2(l, r); *(U2*)(l + LITV(1)) = r; NEXT;
+    OP(SRO4, SZ4 + SRO) POP2(l, r); *(U4*)(l + LITV(1)) = r; NEXT;
+
+    OP(SRLL1, SZ1 + SRLL) *(U1*) (RS_topRef(k) + LITV(2)) = POP(); NEXT;
+    OP(SRLL2, SZ2 + SRLL) *(U2*) (RS_topRef(k) + LITV(2)) = POP(); NEXT;
+    OP(SRLL4, SZ4 + SRLL) *(U4*) (RS_topRef(k) + LITV(2)) = POP(); NEXT;
+
+    OP(LIT1, SZ1 + LIT) PUSH(LITV(1)); NEXT;
+    OP(LIT2, SZ2 + LIT) PUSH(LITV(2)); NEXT;
+    OP(LIT4, SZ4 + LIT) PUSH(LITV(4)); NEXT;
+
+    // Fused Mem Cases
+#define FTLO_REF()  (l = LIT_LO(2), r = LIT_HI(1), *(U4*)(RS_topRef(k) + l) + r)
+    OP(FTLO1, SZ1 + FTLO) PUSH(*(U1*)FTLO_REF()); NEXT;
+    OP(FTLO2, SZ2 + FTLO) PUSH(*(U2*)FTLO_REF()); NEXT;
+    OP(FTLO4, SZ4 + FTLO) PUSH(*(U4*)FTLO_REF()); NEXT;
+#undef FTLO_REF
+
+    OP(SRFTLL1, SZ1 + SRFTLL) l = LIT_LO(2); r = LIT_HI(2);
+      *(U1*)(RS_topRef(k) + l) = POP(); PUSH(*(U1*)(RS_topRef(k) + r)); NEXT;
+    OP(SRFTLL2, SZ2 + SRFTLL) l = LIT_LO(2); r = LIT_HI(2);
+      *(U2*)(RS_topRef(k) + l) = POP(); PUSH(*(U2*)(RS_topRef(k) + r)); NEXT;
+    OP(SRFTLL4, SZ4 + SRFTLL) l = LIT_LO(2); r = LIT_HI(2);
+      *(U4*)(RS_topRef(k) + l) = POP(); PUSH(*(U4*)(RS_topRef(k) + r)); NEXT;
 
     // // Jmp Cases
-    case LCL: // grow locals stack
+    OP(LCL, LCL) // grow locals stack
       assert(false);
-  //     r = (U1)WS_POP();
+  //     r = (U1)POP();
   //     ASSERT(CSZ.sp < CSZ.cap, "CSZ oob");
   //     l = CSZ.dat[CSZ.sp];
   //     ASSERT((U4)l + r < 0xFF, "Local SZ oob");
@@ -338,36 +845,79 @@ inline static U1 executeInstr(Kern* k, U1 instr) {
   //     ASSERT((I4)CS.sp - r > 0, "Locals oob");
   //     CS.sp -= r;
   //     R0
-    case XL:  xImpl(k, (Ty*) popLit(k, 4));    R0
-    case XLL: xImpl(k, (Ty*) (RS_topRef(k) + popLit(k, 2)));     R0;
+    OP(XL, XL)   SPILL(); xImpl(k, (Ty*) LITV(4));    FUEL(); NEXT;
+    OP(XLT, XLT) SPILL(); xltImpl(k, (Ty*) LITV(4));  FUEL(); NEXT;
+    OP(XLL, XLL) SPILL(); xImpl(k, (Ty*) (RS_topRef(k) + LITV(2))); FUEL(); NEXT;
     // The role must be in locals as {&MRole, &Data}
-    case XRL: {
-      S* role = (S*) (RS_topRef(k) + popLit(k, 2));
-      WS_ADD((S)(role + 1)); // push &Data onto stack
-      xImpl(k, (Ty*) role[popLit(k, 1)]);
-      return 0;
+    OP(XRL, XRL) {
+      S* role = (S*) (RS_topRef(k) + LIT_LO(2));
+      PUSH((S)(role + 1)); // push &Data onto stack
+      SPILL(); xImpl(k, (Ty*) role[LIT_HI(1)]);
+      FUEL(); NEXT;
     }
 
-    case SZ1 + JL: r = popLit(k, 1); cfb->ep +=  (I1)r - 1; R0
-    case SZ2 + JL: r = popLit(k, 2); cfb->ep +=  (I2)r - 2; R0
+    OP(JL1, SZ1 + JL) JMP(JMP_TO(1, I1)); NEXT;
+    OP(JL2, SZ2 + JL) JMP(JMP_TO(2, I2)); NEXT;
     // case SZ4 + JL: r = popLit(k, 4); cfb->ep  = (U1*)r    ; R0
 
-    case SZ1 + JLZ: r = popLit(k, 1); if(!WS_POP()) { cfb->ep += (I1)r - 1; } R0
-    case SZ2 + JLZ: r = popLit(k, 2); if(!WS_POP()) { cfb->ep += (I2)r - 2; } R0
-    // case SZ4 + JLZ: r = popLit(k, 4); if(!WS_POP()) { cfb->ep  = (U1*)r;    } R0
+    OP(JLZ1, SZ1 + JLZ) { U1* to = JMP_TO(1, I1); if(!POP()) JMP(to); } NEXT;
+    OP(JLZ2, SZ2 + JLZ) { U1* to = JMP_TO(2, I2); if(!POP()) JMP(to); } NEXT;
+    // case SZ4 + JLZ: r = popLit(k, 4); if(!POP()) { cfb->ep  = (U1*)r;    } R0
+
+    OP(JLZK1, SZ1 + JLZK) { U1* to = JMP_TO(1, I1); if(!TOP()) JMP(to); } NEXT;
+    OP(JLZK2, SZ2 + JLZK) { U1* to = JMP_TO(2, I2); if(!TOP()) JMP(to); } NEXT;
+
+    OP(JNE1, SZ1 + JNE) { U1* to = JMP_TO(1, I1); POP2(l, r); if(l != r) JMP(to); } NEXT;
+    OP(JNE2, SZ2 + JNE) { U1* to = JMP_TO(2, I2); POP2(l, r); if(l != r) JMP(to); } NEXT;
 
-    case SZ1 + JTBL: assert(false);
-    case SZ2 + JTBL: assert(false);
-    case SZ4 + JTBL: assert(false); // TODO: not impl
+    // Index out of bounds continues after the table
+    OP(JTBL1, SZ1 + JTBL) cfb->ep = JTBL_TO(1, I1); NEXT;
+    OP(JTBL2, SZ2 + JTBL) cfb->ep = JTBL_TO(2, I2); NEXT;
+    OP(JTBL4, SZ4 + JTBL) cfb->ep = JTBL_TO(4, I4); NEXT;
 
-    case SZ1 + SLIC: slcImpl(k, 1); R0;
-    case SZ2 + SLIC: slcImpl(k, 2); R0;
-    case SZ4 + SLIC: slcImpl(k, 4); R0;
+    OP(SLIC1, SZ1 + SLIC) INLINE_SLC(1); NEXT;
+    OP(SLIC2, SZ2 + SLIC) INLINE_SLC(2); NEXT;
+    OP(SLIC4, SZ4 + SLIC) INLINE_SLC(4); NEXT;
 
-    default: if(instr >= SLIT) { WS_ADD(0x3F & instr); R0 }
+    // Not implemented
+    OP(DV, DV) OP(RG, RG) OP(IEND, IEND) OP(JW, JW)
+    OP(JL4, SZ4 + JL) OP(JLZ4, SZ4 + JLZ) OP(JLZK4, SZ4 + JLZK) OP(JNE4, SZ4 + JNE)
+      goto I_UNKNOWN;
+
+#ifdef FNGI_THREADED
+    I_SLIT: PUSH(SLIT_V); NEXT;
+#else
+    default: if(instr >= SLIT) { PUSH(SLIT_V); NEXT; }
   }
-  SET_ERR(SLC("Unknown instr"));
-}
+#endif
+I_UNKNOWN:
+  SPILL(); SET_ERR(SLC("Unknown instr"));
+}
+#undef FETCH
+#undef LITV
+#undef SLIT_V
+#undef GREF
+#undef JMP_TO
+#undef JTBL_TO
+#undef LIT_LO
+#undef LIT_HI
+#undef INLINE_SLC
+#undef TRACE_INSTR
+#undef HIST_INSTR
+#undef DISPATCH
+#undef OP
+#undef NEXT
+#undef POP
+#undef PUSH
+#undef TOP
+#undef SPILL
+#undef TRACE_TOS
+#undef PANIC_IF
+#undef POP2
+#undef PUSH2
+#undef PUSH3
+#undef FUEL
+#undef JMP
 
 typedef struct { U2 i; U2 rs; bool found; } PanicHandler;
 PanicHandler getPanicHandler(Kern* k) { // find the index of the panic handler
@@ -395,71 +945,962 @@ bool catchPanic(Kern* k) { // handle a panic and return whether it is caught
   return true;
 }
 
-void yield() {
-  assert(false);
+// ***********************
+//   * fibers
+// Fibers are scheduled cooperatively: YLD puts cfb at the end of the ready
+// queue and continues with the first fiber in it. All of a fiber's state is in
+// its FnFiber, so a switch only changes cfb. Only the outermost executeLoop
+// switches, since a nested one was started by a native which has to continue
+// on the same fiber (YLD is a no-op there).
+
+static void FiberQ_add(FiberQ* q, FnFiber* fb) {
+  fb->next = NULL;
+  if(q->tail) q->tail->next = fb;
+  else        q->head = fb;
+  q->tail = fb;
 }
 
-void executeLoop(Kern* k) { // execute fibers until all fibers are done.
-  jmp_buf local_errJmp;
-  jmp_buf* prev_errJmp = civ.fb->errJmp; civ.fb->errJmp = &local_errJmp;
-  while(cfb) {
-    if(setjmp(local_errJmp)) { // got panic
-      if(!catchPanic(k)) {
-        civ.fb->errJmp = prev_errJmp;
-        Slc path = CStr_asSlcMaybe(k->g.srcInfo->path);
-        eprintf("!! Uncaught panic: %.*s[%u]\n", Dat_fmt(path), k->g.srcInfo->line);
-        longjmp(*prev_errJmp, 1);
-        assert(false);
+static FnFiber* FiberQ_pop(FiberQ* q) {
+  FnFiber* fb = q->head;
+  if(fb and not (q->head = fb->next)) q->tail = NULL;
+  return fb;
+}
+
+static void readyAdd(Kern* k, FnFiber* fb) {
+  fb->state = FIBER_READY; FiberQ_add(&k->ready, fb);
+}
+
+// Push fb on a lock-free stack (a Kern's inbox or a chan's parked fibers),
+// which is only ever taken as a whole with atomic_exchange.
+static void fiberPush(_Atomic(FnFiber*)* q, FnFiber* fb) {
+  fb->next = atomic_load(q);
+  while(not atomic_compare_exchange_weak(q, &fb->next, fb)) {}
+}
+
+// Make fb (blocked) ready. A fiber of another Kern is pushed on that Kern's
+// inbox, which readyPop moves to its ready queue.
+static void fiberWake(Kern* k, FnFiber* fb) {
+  if(fb->kern == k) readyAdd(k, fb);
+  else              fiberPush(&fb->kern->inbox, fb);
+}
+
+static bool chanRetry(Kern* k, FnFiber* fb);
+static void chanUnpark(Kern* k, FnFiber* fb);
+
+// Pop the next fiber to run. A fiber woken from a chan first retries its op
+// and is parked again if it still can't proceed.
+static FnFiber* readyPop(Kern* k) {
+  while(true) {
+    if(atomic_load(&k->inbox)) {
+      FnFiber* fb = atomic_exchange(&k->inbox, NULL);
+      while(fb) { FnFiber* n = fb->next; readyAdd(k, fb); fb = n; }
+    }
+    FnFiber* fb = FiberQ_pop(&k->ready);
+    if(not fb or not fb->wait or chanRetry(k, fb)) return fb;
+  }
+}
+
+// With FNGI_MT a Kern whose fibers are all parked on chans waits for another
+// Kern to wake them. Otherwise nothing can, and the blocked cfb panics.
+void yield(Kern* k) {
+  if(k->loopDepth > 1) return;
+  if(FIBER_BLOCKED != cfb->state) readyAdd(k, cfb);
+  FnFiber* fb = readyPop(k);
+#ifdef FNGI_MT
+  while(not fb and k->parked) fb = readyPop(k);
+#endif
+  if(not fb) {
+    if(not cfb->wait) SET_ERR(SLC("deadlock: blocked in join, no fiber is ready"));
+    chanUnpark(k, cfb); // so the chan can't wake it once the panic unwinds
+    SET_ERR(SLC("deadlock: blocked on a chan, no fiber is ready"));
+  }
+  statsSwitch(k, fb); cfb = fb;
+}
+
+// cfb returned from its first fn. A spawned fiber is done: wake its joiners and
+// put it in the pool. Then run the next ready fiber, if any (else cfb=NULL).
+static void fiberDone(Kern* k, FnFiber* main) {
+  FnFiber* fb = cfb; fb->ep = NULL;
+  if(fb != main) {
+    fb->state = FIBER_DONE;
+    while(fb->joiners) {
+      FnFiber* j = fb->joiners; fb->joiners = j->next;
+      readyAdd(k, j);
+    }
+    fb->next = k->fiberPool[fb->cls]; k->fiberPool[fb->cls] = fb;
+  }
+  FnFiber* next = (k->loopDepth > 1) ? NULL : readyPop(k);
+  statsSwitch(k, next); cfb = next;
+}
+
+#define FIBER_SLAB(CLS)  (BLOCK_SIZE >> (4 - 2 * (CLS)))
+
+// The info and return stack caps of a fiber of cls. The WS is always WS_DEPTH.
+static inline U2 fiberWords(U1 cls) {
+  return (FIBER_SLAB(cls) - sizeof(FnFiber)) / RSIZE - WS_DEPTH;
+}
+#define FIBER_INFO(CLS)  (fiberWords(CLS) / 4)
+#define FIBER_RS(CLS)    (fiberWords(CLS) - FIBER_INFO(CLS))
+
+// Fill the pool of cls from a new block.
+static void fiberPoolFill(Kern* k, U1 cls) {
+  if(FIBER_LARGE == cls) {
+    FnFiber* fb = (FnFiber*) BBA_alloc(k->g.bbaDict, sizeof(FnFiber), RSIZE);
+    ASSERT(fb, "spawn OOM"); memset(fb, 0, sizeof(FnFiber));
+    ASSERT(FnFiber_initBA(fb, k->ba), "spawn OOM");
+    fb->cls = cls; k->fiberPool[cls] = fb;
+    return;
+  }
+  U1* slab = (U1*) BA_alloc(k->ba); ASSERT(slab, "spawn OOM");
+  for(U2 i = 0; i < BLOCK_SIZE; i += FIBER_SLAB(cls)) {
+    FnFiber* fb = (FnFiber*) (slab + i); memset(fb, 0, sizeof(FnFiber));
+    U4* dat = (U4*) (fb + 1);
+    fb->ws   = Stk_init(dat, WS_DEPTH);        dat += WS_DEPTH;
+    fb->info = Stk_init(dat, FIBER_INFO(cls)); dat += FIBER_INFO(cls);
+    fb->rs   = Stk_init(dat, FIBER_RS(cls));
+    fb->cls = cls; fb->next = k->fiberPool[cls]; k->fiberPool[cls] = fb;
+  }
+}
+
+typedef struct { U2 info; U2 rs; } FnDepth;
+#define DEPTH_UNBOUNDED  ((FnDepth) { 0xFFFF, 0xFFFF })
+
+// The worst case info and return stack use of calling fn (within lvl nested
+// calls). Natives are counted as zero, dynamic calls and recursion as unbounded.
+static FnDepth fnDepth(TyFn* fn, U1 lvl) {
+  FnDepth d = {0};
+  if(isFnNative(fn)) return d;
+  if(not fn->code or not lvl) return DEPTH_UNBOUNDED;
+  for(U2 i = 0; i < fn->len; i = instrNext(fn->code, i)) {
+    U1 instr = fn->code[i];
+    if((XLL == instr) or (XRL == instr) or (JW == instr)) return DEPTH_UNBOUNDED;
+    if((XL != instr) and (XLT != instr)) continue;
+    FnDepth c = fnDepth(tyFn((Ty*)ftBE(fn->code + i + 1, 4)), lvl - 1);
+    if(0xFFFF == c.info) return DEPTH_UNBOUNDED;
+    if(c.info > d.info) d.info = c.info;
+    if(c.rs   > d.rs)   d.rs   = c.rs;
+  }
+  d.info += 1; d.rs += fn->lSlots + 1;
+  return d;
+}
+
+U1 fnFiberCls(TyFn* fn) {
+  FnDepth d = fnDepth(fn, 8);
+  for(U1 cls = FIBER_SMALL; cls < FIBER_LARGE; cls++) {
+    if((d.info < FIBER_INFO(cls)) and (d.rs < FIBER_RS(cls))) return cls;
+  }
+  return FIBER_LARGE;
+}
+
+FnFiber* Kern_spawn(Kern* k, TyFn* fn) {
+  U1 cls = fnFiberCls(fn);
+  if(not k->fiberPool[cls]) fiberPoolFill(k, cls);
+  FnFiber* fb = k->fiberPool[cls]; k->fiberPool[cls] = fb->next;
+  Stk_clear(&fb->ws); Stk_clear(&fb->info); Stk_clear(&fb->rs);
+  fb->joiners = NULL; fb->gen += 1; fb->kern = k; fb->wait = NULL;
+#ifdef FNGI_FUEL
+  fb->used = 0; fb->tickLen = 0;
+  FnFiber_setFuel(fb, FUEL_INF, k->fuelSlice);
+#endif
+#ifdef FNGI_XCACHE
+  fb->start[0] = (XCell) { .h = xcHandler(XL), .a = (S)fn };
+  fb->start[1] = (XCell) { .h = xcHandler(RET) };
+  fb->ep = (U1*) fb->start;
+#else
+  Buf b = (Buf) { .dat = fb->start, .cap = sizeof(fb->start) };
+  Buf_add(&b, XL); Buf_addBE4(&b, (S)fn); Buf_add(&b, RET);
+  fb->ep = fb->start;
+#endif
+  readyAdd(k, fb);
+  return fb;
+}
+
+// The fibers table is indexed by id (its "hash"), so ids are kept as it grows.
+static U4 fiberIdHash(U1* e) { return (*(FnFiber**)e)->id; }
+
+S Kern_fiberHandle(Kern* k, FnFiber* fb) {
+  if(not fb->id) { // first handle: give fb an id (ids start at 1)
+    ASSERT(k->fibers.len < 0xFFFF, "too many fibers");
+    Tbl_reserve(k, &k->fibers, fiberIdHash);
+    fb->id = ++k->fibers.len; *(FnFiber**)Tbl_at(&k->fibers, fb->id) = fb;
+  }
+  return ((S)fb->gen << 16) | fb->id;
+}
+
+FnFiber* Kern_fiber(Kern* k, S h) {
+  U2 id = h & 0xFFFF;
+  ASSERT(id and (id <= k->fibers.len), "not a fiber");
+  FnFiber* fb = *(FnFiber**)Tbl_at(&k->fibers, id);
+  return (fb->gen == (h >> 16)) ? fb : NULL;
+}
+
+// ***********************
+//   * channels
+// Values always go through the ring (see Chan). A fiber which can't proceed
+// parks on the chan's senders or recvers, with its value (or for one) in msg.
+// The counterpart op takes all of them and wakes them, and readyPop retries
+// their op on their own Kern. Both the park and the op check the other side
+// after a seq_cst fence, so one of them always sees the other.
+//
+// Like fibers, a small chan is carved out of a slab of CHAN_SLAB bytes and
+// reused from k->chanPool once freed. A larger one uses a block. The cells
+// take at most half of either.
+#define CHAN_SLAB      (BLOCK_SIZE / 16)
+#define CHAN_SMALL     (CHAN_SLAB / 2 / sizeof(ChanCell)) // max cap
+#define CHAN_MAX       (BLOCK_SIZE / 2 / sizeof(ChanCell))
+_Static_assert(sizeof(Chan) <= CHAN_SLAB / 2, "Chan too large for its slab");
+
+#define LOAD_ACQ(A)      atomic_load_explicit(A, memory_order_acquire)
+#define STORE_REL(A, V)  atomic_store_explicit(A, V, memory_order_release)
+#define LOAD_RLX(A)      atomic_load_explicit(A, memory_order_relaxed)
+#define STORE_RLX(A, V)  atomic_store_explicit(A, V, memory_order_relaxed)
+
+Chan* Kern_chan(Kern* k, S cap, bool mpsc) {
+  ASSERT(cap <= CHAN_MAX, "chan: cap too large");
+  U2 n = 1; while(n < cap) n <<= 1;
+  Chan* ch;
+  if(n > CHAN_SMALL) { ch = (Chan*) BA_alloc(k->ba); ASSERT(ch, "chan OOM"); }
+  else {
+    if(not k->chanPool) {
+      U1* slab = (U1*) BA_alloc(k->ba); ASSERT(slab, "chan OOM");
+      for(U2 i = 0; i < BLOCK_SIZE; i += CHAN_SLAB) {
+        ch = (Chan*) (slab + i); ch->next = k->chanPool; k->chanPool = ch;
       }
     }
-    U1 res = executeInstr(k, popLit(k, 1));
+    ch = k->chanPool; k->chanPool = ch->next;
+  }
+  *ch = (Chan) { .mask = n - 1, .mpsc = mpsc, .owner = k };
+  for(U2 i = 0; i < n; i++) atomic_init(&ch->dat[i].seq, 2 * i);
+  return ch;
+}
+
+void Kern_chanFree(Kern* k, Chan* ch) {
+  ASSERT(ch->owner == k, "chan: free on another Kern");
+  ASSERT(not atomic_load(&ch->senders) and not atomic_load(&ch->recvers),
+         "chan: free with parked fibers");
+  if(ch->mask >= CHAN_SMALL) return BA_free(k->ba, ch);
+  ch->next = k->chanPool; k->chanPool = ch;
+}
+
+// Claim a side of ch which only one Kern may use.
+static void chanSide(Kern* k, _Atomic(Kern*)* side) {
+  Kern* s = atomic_load(side);
+  if(not s and atomic_compare_exchange_strong(side, &s, k)) return;
+  ASSERT(s == k, "chan: used by a second Kern");
+}
+
+// Wake the fibers parked on q. self is still running (see chanPark), so it
+// is only marked ready and its YLD requeues it.
+static void chanWakeAll(Kern* k, _Atomic(FnFiber*)* q, FnFiber* self) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if(not atomic_load(q)) return;
+  for(FnFiber* fb = atomic_exchange(q, NULL); fb; ) {
+    FnFiber* n = fb->next;
+    if(fb == self) fb->state = FIBER_READY;
+    else           fiberWake(k, fb);
+    fb = n;
+  }
+}
+
+bool Chan_trySend(Kern* k, Chan* ch, S v) {
+  if(not ch->mpsc) chanSide(k, &ch->sendK);
+  U4 p = LOAD_RLX(&ch->tail); ChanCell* c;
+  while(true) {
+    c = &ch->dat[p & ch->mask];
+    I4 d = LOAD_ACQ(&c->seq) - 2 * p;
+    if(d < 0) return false; // full
+    if(d > 0) p = LOAD_RLX(&ch->tail); // claimed by another sender
+    else if(not ch->mpsc) { STORE_RLX(&ch->tail, p + 1); break; }
+    else if(atomic_compare_exchange_weak_explicit(&ch->tail, &p, p + 1,
+              memory_order_relaxed, memory_order_relaxed)) break;
+  }
+  c->v = v; STORE_REL(&c->seq, 2 * p + 1);
+  chanWakeAll(k, &ch->recvers, NULL);
+  return true;
+}
+
+bool Chan_tryRecv(Kern* k, Chan* ch, S* v) {
+  chanSide(k, &ch->recvK);
+  U4 p = LOAD_RLX(&ch->head); ChanCell* c = &ch->dat[p & ch->mask];
+  if(LOAD_ACQ(&c->seq) != 2 * p + 1) return false; // empty
+  *v = c->v; STORE_REL(&c->seq, 2 * (p + ch->mask + 1)); // free for p + cap
+  STORE_RLX(&ch->head, p + 1);
+  chanWakeAll(k, &ch->senders, NULL);
+  return true;
+}
+
+// Whether a send (recv) on ch would find a free (full) cell.
+static bool chanReady(Chan* ch, bool send) {
+  atomic_thread_fence(memory_order_seq_cst);
+  U4 p = atomic_load(send ? &ch->tail : &ch->head);
+  return atomic_load(&ch->dat[p & ch->mask].seq) == 2 * p + not send;
+}
+
+static inline _Atomic(FnFiber*)* chanQ(FnFiber* fb) {
+  return fb->waitSend ? &fb->wait->senders : &fb->wait->recvers;
+}
+
+// Park fb on its chan. An op which completed before the push is seen by
+// chanReady, which then wakes the parked fibers (including fb) itself.
+static void chanPark(Kern* k, FnFiber* fb, FnFiber* self) {
+  fb->state = FIBER_BLOCKED; fiberPush(chanQ(fb), fb);
+  if(chanReady(fb->wait, fb->waitSend)) chanWakeAll(k, chanQ(fb), self);
+}
+
+// Park cfb on ch, the caller must YLD.
+static void chanBlock(Kern* k, Chan* ch, bool send) {
+  ASSERT(1 == k->loopDepth, "chan: would block, not in the outermost executeLoop");
+  cfb->wait = ch; cfb->waitSend = send; k->parked += 1;
+  chanPark(k, cfb, cfb);
+}
+
+// fb was woken from its chan: retry its op, else park it again.
+static bool chanRetry(Kern* k, FnFiber* fb) {
+  Chan* ch = fb->wait;
+  if(fb->waitSend ? Chan_trySend(k, ch, fb->msg)
+                  : Chan_tryRecv(k, ch, &fb->msg)) {
+    fb->wait = NULL; k->parked -= 1;
+    return true;
+  }
+  chanPark(k, fb, NULL);
+  return false;
+}
+
+// Take fb off its chan (it is parked and not woken).
+static void chanUnpark(Kern* k, FnFiber* fb) {
+  _Atomic(FnFiber*)* q = chanQ(fb);
+  for(FnFiber* w = atomic_exchange(q, NULL); w; ) {
+    FnFiber* n = w->next;
+    if(w != fb) fiberPush(q, w);
+    w = n;
+  }
+  if(chanReady(fb->wait, fb->waitSend)) chanWakeAll(k, q, NULL);
+  fb->wait = NULL; fb->state = FIBER_READY; k->parked -= 1;
+}
+
+// Execute cfb until it is done, switching fibers on YLD. An outermost loop
+// also runs the rest of the ready fibers before returning. A panic which is not
+// caught ends only the fiber it happened in, unless that is the loop's own.
+void executeLoop(Kern* k) {
+  FnFiber* main = cfb; k->loopDepth += 1;
+  jmp_buf local_errJmp;
+  jmp_buf* prev_errJmp = FNGI_ERRJMP; FNGI_ERRJMP = &local_errJmp;
+  if(setjmp(local_errJmp)) { // got panic, stays armed until the loop exits
+    if(catchPanic(k)) {}
+    else if(cfb != main) {
+      Slc path = CStr_asSlcMaybe(k->g.srcInfo->path);
+      eprintf("!! Uncaught panic in fiber: %.*s[%u]\n", Dat_fmt(path), k->g.srcInfo->line);
+      Stk_clear(WS); fiberDone(k, main);
+    } else {
+      FNGI_ERRJMP = prev_errJmp; k->loopDepth -= 1;
+      Slc path = CStr_asSlcMaybe(k->g.srcInfo->path);
+      eprintf("!! Uncaught panic: %.*s[%u]\n", Dat_fmt(path), k->g.srcInfo->line);
+      longjmp(*errJmp(), 1);
+      assert(false);
+    }
+  }
+  while(cfb) {
+    U1 res = executeInstr(k);
     if(res) {
-      if(YLD == res) yield();
+      if(YLD == res) yield(k);
       else /* RET */ {
-        if(0 == Stk_len(RS)) {  // empty stack, fiber done
-          cfb->ep = NULL;
-          break;
-        } else ret(k);
+        if(0 == Stk_len(RS)) fiberDone(k, main); // empty stack, fiber done
+        else                 ret(k);
       }
     }
   }
-  civ.fb->errJmp = prev_errJmp;
+  statsSwitch(k, main); cfb = main; k->loopDepth -= 1;
+  FNGI_ERRJMP = prev_errJmp;
 }
 
 void executeFn(Kern* k, TyFn* fn) {
   // eprintf("!!! executeFn %.*s: ", Ty_fmt(fn)); dbgWs(k); NL;
   if(isFnNative(fn)) return executeNative(k, fn);
-  cfb->ep = fn->code;
+  cfb->ep = fnEp(k, fn);
   executeLoop(k);
 }
 
+#ifdef FNGI_JIT
+//   *******
+//   * 2.c: Template JIT
+// With FNGI_JIT a fn called FNGI_JIT_HOT times through xImpl is compiled to
+// native x86 (i386 cdecl) as a `void fn(Kern*)`. It pushes the same frame as
+// xImpl and pops it with ret, so JIT'd and interpreted frames interoperate
+// (including catchPanic, which longjmps out of native code as usual).
+//
+// Registers: ebx=k, esi=locals, edi=WS. Each instr is a template. Common ones
+// use WS directly and fall back to jitStep if the WS bounds would be violated
+// (so the panic is identical). The rest simply call jitStep, which executes
+// the single instr with executeInstr. Fns which YLD, make dynamic calls
+// (XLL/XRL) or call a fn which can't be compiled are left interpreted.
+#include <sys/mman.h>
+
+#ifndef FNGI_JIT_HOT
+#define FNGI_JIT_HOT  64
+#endif
+#define JIT_NEVER     0xFFFF
+#define JIT_BUSY      0xFFFE // being compiled
+#define JIT_ROUND     256    // fns compiled together by one fnJit
+#define JIT_SZ        0x40000
+#define JIT_ARGS      28 // space for call args, keeps esp 16 byte aligned
+
+_Static_assert(sizeof(((Stk*)0)->sp) == 2, "JIT: Stk.sp must be U2");
+
+static FNGI_TLS U1* jitDat = NULL; static FNGI_TLS U4 jitLen = 0; // per thread
+static FNGI_TLS TyFn* jitRound[JIT_ROUND]; static FNGI_TLS U2 jitRoundLen = 0;
+
+typedef struct {
+  U1* code; U4 entry;
+  U4* nat;                         // code index -> jitDat index
+  U4* fixAt; U2* fixTo; U2 fixLen; // jmps to code indexes
+  U4 slow[2]; U1 slowLen;          // guards which jmp to jitStep
+} Jit;
+
+static void jitStep(Kern* k, U1* instr) {
+  cfb->ep = instr;
+  executeInstr(k);
+}
+
+#define JB(...) do { \
+    U1 _b[] = {__VA_ARGS__}; memcpy(jitDat + jitLen, _b, sizeof(_b)); \
+    jitLen += sizeof(_b); \
+  } while(0)
+static void j4(U4 v) { memcpy(jitDat + jitLen, &v, 4); jitLen += 4; }
+static void jitPatch(U4 at, U4 to) { U4 rel = to - (at + 4); memcpy(jitDat + at, &rel, 4); }
+
+static void jitCallK(void* fn, bool hasArg, U4 arg) { // fn(k, arg)
+  JB(0x89, 0x1C, 0x24);                             // mov [esp], ebx
+  if(hasArg) { JB(0xC7, 0x44, 0x24, 0x04); j4(arg); } // mov [esp+4], arg
+  JB(0xE8); j4((U4)fn - (U4)(jitDat + jitLen + 4)); // call fn
+}
+static void jitCallFn(TyFn* fn) { // fn(k) through fn->jit, set later
+  JB(0x89, 0x1C, 0x24, 0xFF, 0x15); j4((U4)&fn->jit); // call [&fn->jit]
+}
+
+static void jitJmp(Jit* j, U1 cc, U2 to) { // cc=0: jmp, else jcc
+  if(cc) JB(0x0F, cc); else JB(0xE9);
+  j->fixAt[j->fixLen] = jitLen; j->fixTo[j->fixLen++] = to; j4(0);
+}
+
+#define JCC_EQ  0x84
+#define JCC_NE  0x85
+#define JCC_AE  0x83
+
+// WS access: ecx=sp, edx=dat
+static void jitLdSp(void)  { JB(0x0F, 0xB7, 0x8F);  j4(offsetof(Stk, sp)); }
+static void jitStSp(void)  { JB(0x66, 0x89, 0x8F);  j4(offsetof(Stk, sp)); }
+static void jitLdDat(void) { JB(0x8B, 0x97);        j4(offsetof(Stk, dat)); }
+static void jitGuard(Jit* j, U1 cc) {
+  JB(0x0F, cc); j->slow[j->slowLen++] = jitLen; j4(0);
+}
+static void jitHas(Jit* j, U1 n) { // ws has at least n (1 or 2) items
+  if(n > 1) JB(0x8D, 0x41, n - 1);                       // lea eax, [ecx+n-1]
+  JB(0x66, 0x3B, (n > 1) ? 0x87 : 0x8F); j4(offsetof(Stk, cap)); // cmp ?x, cap
+  jitGuard(j, JCC_AE);
+}
+static void jitRoom(Jit* j) { JB(0x85, 0xC9); jitGuard(j, JCC_EQ); } // test ecx
+static void jitPushEax(void) {
+  JB(0x49); jitStSp(); jitLdDat(); JB(0x89, 0x04, 0x8A); // [--sp] = eax
+}
+static void jitPopEax(void) { // eax = [sp++], after jitHas
+  jitLdDat(); JB(0x8B, 0x04, 0x8A, 0x41); jitStSp();
+}
+
+// Whether the instr can be executed by jitStep.
+static bool jitCanStep(U1 instr) {
+  if(instr >= SLIT) return true;
+  switch(instr) {
+    case RET: case RETZ: case YLD: case DV: case RG: case IEND:
+    case LCL: case XL: case XLT: case XLL: case XRL: case JW: return false;
+  }
+  if(instr >= 0x80) return SLIC == (~SZ_MASK & instr);
+  return instrName(instr).dat != unknownInstr;
+}
+
+static bool jitIsJmp(U1 instr) {
+  U1 base = ~SZ_MASK & instr;
+  if((instr < 0x80) or (instr >= SLIT) or (SZ4 == (SZ_MASK & instr))) return false;
+  return (JL == base) or (JLZ == base) or (JLZK == base) or (JNE == base);
+}
+
+static void jitInstr(Jit* j, TyFn* fn, U2 i) {
+  U1 instr = j->code[i]; U1* lit = j->code + i + 1; U4 v;
+  U1 base = ~SZ_MASK & instr;
+  if(instr >= SLIT or isMemOp(instr, LIT)) {
+    v = (instr >= SLIT) ? (0x3F & instr) : ftBE(lit, szIToSz(instr));
+    jitLdSp(); jitRoom(j);
+    JB(0x49); jitStSp(); jitLdDat(); JB(0xC7, 0x04, 0x8A); j4(v); // [--sp] = v
+  } else if(jitIsJmp(instr)) {
+    U2 to = jmpTarget(j->code, i);
+    if(JL == base) jitJmp(j, 0, to);
+    else if(JNE == base) {
+      jitLdSp(); jitHas(j, 2); jitLdDat();
+      JB(0x8B, 0x04, 0x8A, 0x83, 0xC1, 0x02); jitStSp(); // eax=r; sp+=2
+      JB(0x3B, 0x44, 0x8A, 0xFC); jitJmp(j, JCC_NE, to);  // cmp eax, l
+    } else {
+      jitLdSp(); jitHas(j, 1);
+      if(JLZ == base) jitPopEax();
+      else { jitLdDat(); JB(0x8B, 0x04, 0x8A); }          // JLZK: eax=top
+      JB(0x85, 0xC0); jitJmp(j, JCC_EQ, to);
+    }
+  } else switch(instr) {
+    case RET:  jitJmp(j, 0, fn->len); break;
+    case RETZ: jitLdSp(); jitHas(j, 1); jitPopEax();
+               JB(0x85, 0xC0); jitJmp(j, JCC_EQ, fn->len); break;
+    case XL: case XLT: {
+      TyFn* callee = tyFn((Ty*)ftBE(lit, 4));
+      void* to = isFnNative(callee) ? (void*)callee->code
+               : (callee == fn)     ? (void*)(jitDat + j->entry) : callee->jit;
+      if((XL == instr) or isFnNative(callee)) {
+        if(to) jitCallK(to, false, 0); else jitCallFn(callee);
+        break;
+      }
+      jitCallK(ret, false, 0); // tail call: pop our frame, then jmp to the callee
+      JB(0x83, 0xC4, JIT_ARGS, 0x5F, 0x5E, 0x5B, 0x5D);
+      if(to) { JB(0xE9); j4((U4)to - (U4)(jitDat + jitLen + 4)); }
+      else   { JB(0xFF, 0x25); j4((U4)&callee->jit); } // jmp [&callee->jit]
+      break;
+    }
+    case DUP: jitLdSp(); jitHas(j, 1); jitRoom(j);
+              jitLdDat(); JB(0x8B, 0x04, 0x8A); jitPushEax(); break;
+    case DRP: jitLdSp(); jitHas(j, 1); JB(0x41); jitStSp(); break;
+    case ADD: case SUB: case MSK: case JN: case XOR: {
+      U1 op = (ADD == instr) ? 0x01 : (SUB == instr) ? 0x29
+            : (MSK == instr) ? 0x21 : (JN  == instr) ? 0x09 : 0x31;
+      jitLdSp(); jitHas(j, 2); jitLdDat();
+      JB(0x8B, 0x04, 0x8A, op, 0x44, 0x8A, 0x04, 0x41); jitStSp(); // [sp+1] op= [sp++]
+      break;
+    }
+    case INC: case INC2: case INC4: case DEC: case ADDI:
+      v = (INC == instr) ? 1 : (INC2 == instr) ? 2 : (INC4 == instr) ? 4
+        : (DEC == instr) ? -1 : *lit;
+      jitLdSp(); jitHas(j, 1); jitLdDat(); JB(0x81, 0x04, 0x8A); j4(v); break;
+    case SZ4|FTLL:
+      jitLdSp(); jitRoom(j); JB(0x8B, 0x86); j4(ftBE(lit, 2)); jitPushEax(); break;
+    case SZ4|SRLL:
+      jitLdSp(); jitHas(j, 1); jitPopEax(); JB(0x89, 0x86); j4(ftBE(lit, 2)); break;
+    case ADDLL:
+      jitLdSp(); jitRoom(j);
+      JB(0x8B, 0x86); j4(ftBE(lit, 2)); JB(0x03, 0x86); j4(ftBE(lit + 2, 2));
+      jitPushEax(); break;
+    case SZ4|SRFTLL:
+      jitLdSp(); jitHas(j, 1); jitLdDat(); JB(0x8B, 0x04, 0x8A);
+      JB(0x89, 0x86); j4(ftBE(lit, 2));                   // local a = top
+      JB(0x8B, 0x86); j4(ftBE(lit + 2, 2)); JB(0x89, 0x04, 0x8A); // top = b
+      break;
+    default: jitCallK(jitStep, true, (U4)(j->code + i));
+  }
+  if(j->slowLen) { // end of the fast path: emit the jitStep fallback
+    JB(0xE9); U4 over = jitLen; j4(0);
+    for(U1 s = 0; s < j->slowLen; s++) jitPatch(j->slow[s], jitLen);
+    jitCallK(jitStep, true, (U4)(j->code + i));
+    jitPatch(over, jitLen);
+    j->slowLen = 0;
+  }
+}
+
+// Compile fn and the fns it calls. A call to a fn which is still being
+// compiled (mutual recursion) goes through its fn->jit, which is set before
+// anything runs: if any fn in the round fails, fnJit drops the whole round.
+static bool jitCompileFn(Kern* k, TyFn* fn);
+static bool jitCompile(Kern* k, TyFn* fn) {
+  fn->calls = JIT_BUSY;
+  if((jitRoundLen >= JIT_ROUND) or not jitCompileFn(k, fn)) {
+    fn->calls = JIT_NEVER;
+    return false;
+  }
+  jitRound[jitRoundLen++] = fn;
+  fn->calls = 0;
+  return true;
+}
+
+static bool jitCompileFn(Kern* k, TyFn* fn) {
+  U1* code = fn->code; U2 len = fn->len;
+  if(not len) return false;
+  for(U2 i = 0; i < len; i = instrNext(code, i)) {
+    U1 instr = code[i];
+#ifdef FNGI_FUEL // only fns which need no metering
+    if(((XL == instr) or (XLT == instr))
+       and not isFnNative(tyFn((Ty*)ftBE(code + i + 1, 4)))) return false;
+    if(jitIsJmp(instr) and (jmpTarget(code, i) <= i)) return false;
+#endif
+    if((XL == instr) or (XLT == instr)) {
+      TyFn* callee = tyFn((Ty*)ftBE(code + i + 1, 4));
+      if(isFnNative(callee) or (callee == fn) or callee->jit) continue;
+      if(JIT_BUSY == callee->calls) continue;
+      if((JIT_NEVER == callee->calls) or not jitCompile(k, callee)) return false;
+    } else if(jitIsJmp(instr)) {
+      I4 to = jmpTarget(code, i);
+      if((to < 0) or (to > len)) return false;
+    } else if((RET != instr) and (RETZ != instr) and not jitCanStep(instr)) {
+      return false;
+    }
+  }
+  if(not jitDat) {
+    jitDat = mmap(NULL, JIT_SZ, PROT_READ | PROT_WRITE | PROT_EXEC,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(MAP_FAILED == jitDat) { jitDat = NULL; return false; }
+  }
+  if(jitLen + 96 * ((U4)len + 4) > JIT_SZ) return false; // full
+
+  U4 nat[len + 1]; U4 fixAt[len]; U2 fixTo[len];
+  memset(nat, 0xFF, sizeof(nat));
+  Jit j = { .code = code, .entry = jitLen, .nat = nat, .fixAt = fixAt, .fixTo = fixTo };
+  JB(0x55, 0x89, 0xE5, 0x53, 0x56, 0x57);   // push ebp; mov ebp, esp; push regs
+  JB(0x83, 0xEC, JIT_ARGS, 0x8B, 0x5D, 0x08); // sub esp, ARGS; mov ebx, [ebp+8]
+  jitCallK(fnEnter, true, (U4)fn); JB(0x89, 0xC6);  // esi = fnEnter(k, fn)
+  JB(0x8B, 0x83); j4(offsetof(Kern, fb));    // mov eax, k->fb
+  JB(0x8D, 0xB8); j4(offsetof(FnFiber, ws)); // lea edi, [eax+ws]
+  for(U2 i = 0; i < len; i = instrNext(code, i)) {
+    nat[i] = jitLen;
+    jitInstr(&j, fn, i);
+  }
+  nat[len] = jitLen; // epilogue
+  jitCallK(ret, false, 0);
+  JB(0x83, 0xC4, JIT_ARGS, 0x5F, 0x5E, 0x5B, 0x5D, 0xC3); // pop regs; ret
+  for(U2 f = 0; f < j.fixLen; f++) {
+    if(0xFFFFFFFF == nat[fixTo[f]]) { jitLen = j.entry; return false; } // mid-instr
+    jitPatch(fixAt[f], nat[fixTo[f]]);
+  }
+  fn->jit = jitDat + j.entry;
+  return true;
+}
+
+// Get the native code for fn, compiling it once it is hot.
+void* fnJit(Kern* k, TyFn* fn) {
+  if(fn->jit or (JIT_NEVER == fn->calls)) return fn->jit;
+  if(++fn->calls < FNGI_JIT_HOT) return NULL;
+  U4 start = jitLen; jitRoundLen = 0;
+  if(not jitCompile(k, fn)) { // callers may reference fns that failed
+    for(U2 i = 0; i < jitRoundLen; i++) {
+      jitRound[i]->jit = NULL; jitRound[i]->calls = 0;
+    }
+    jitLen = start;
+  }
+  jitRoundLen = 0;
+  return fn->jit;
+}
+#undef JB
+#endif // FNGI_JIT
+
 // ***********************
-// * 3: TyDb, the type database and validator
-// The type database is a stack of TyI Singly Linked Lists.
-// Whenever a function is called, it's inputs are popped from the top SLL and
-// the outputs are added.
-// If statements/etc utilize split/merge operations.
+//   * 2.d: AOT C backend
+// Kern_aot translates the fns of a dict into C: each becomes a
+// `static void aot_N(Kern*)` which pushes the same frame as xImpl and pops it
+// with ret, with every instr written out using the WS macros. The result is
+// compiled into the binary, so gcc optimizes whole fns and nothing is
+// dispatched. Operands which are pointers (XL callees and GR/FTGL/SRGL
+// globals) are emitted by name and resolved by Kern_aotLoad.
+//
+// A fn is emitted only if every callee is native or also emitted and it does
+// not YLD, make dynamic calls (XLL/XRL) or use unimplemented instrs.
+typedef struct {
+  Kern* k; TyDict* dict;
+  TyFn** fns; U2 len;
+  Ty** refs; U2 refLen;
+} Aot;
 
-TYIS(/*extern*/) // global TyI and TyIs, see fngi.h
+static const char* aotTy[] = { "U1", "U2", "U4", NULL };
 
-static inline S szIToSz(U1 szI) {
-  switch(SZ_MASK & szI) {
-    case SZ1: return 1;
-    case SZ2: return 2;
-    case SZ4: return 4;
+static Ty* aotFind(Kern* k, TyDict* dict, CStr* name) {
+  Ty* ty = TyDict_find(dict, CStr_asSlc(name));
+  if(not ty) ty = TyDict_find(&k->g.rootDict, CStr_asSlc(name));
+  return ty ? ty : TyDict_find(&Ty_builtins, CStr_asSlc(name));
+}
+
+static U2 aotCount(CBst* n) { return n ? 1 + aotCount(n->l) + aotCount(n->r) : 0; }
+
+static void aotCollect(Aot* a, CBst* n) {
+  if(not n) return;
+  aotCollect(a, n->l);
+  TyFn* fn = (TyFn*)n;
+  if(isTyFn((Ty*)fn) and not isFnNative(fn) and fn->len
+     and (isFnNormal(fn) or isFnImm(fn))) a->fns[a->len++] = fn;
+  aotCollect(a, n->r);
+}
+
+static I4 aotFnI(Aot* a, TyFn* fn) {
+  for(U2 i = 0; i < a->len; i++) if(a->fns[i] == fn) return i;
+  return -1;
+}
+
+// Get the index of ty in aot_r, or -1 if it can't be found by name.
+static I4 aotRef(Aot* a, Ty* ty) {
+  if(ty != aotFind(a->k, a->dict, ty->bst.key)) return -1;
+  for(U2 i = 0; i < a->refLen; i++) if(a->refs[i] == ty) return i;
+  a->refs[a->refLen] = ty;
+  return a->refLen++;
+}
+
+static void aotStr(FILE* f, U1* dat, U2 len) {
+  fprintf(f, "\"");
+  for(U2 i = 0; i < len; i++) {
+    U1 c = dat[i];
+    if(((c >= 'a') and (c <= 'z')) or ((c >= 'A') and (c <= 'Z'))
+       or ((c >= '0') and (c <= '9')) or (c == '_')) fprintf(f, "%c", c);
+    else fprintf(f, "\\%03o", c);
   }
-  assert(false);
+  fprintf(f, "\"");
 }
 
-static inline S szToSzI(U1 sz) {
-  switch (sz) {
-    case 1: return SZ1;
-    case 2: return SZ2;
-    case 4: return SZ4;
+static const char* aotBinOp(U1 instr) {
+  switch(instr) {
+    case ADD:  return "+";  case SUB:   return "-";  case MOD: return "%";
+    case SHL:  return "<<"; case SHR:   return ">>"; case MSK: return "&";
+    case JN:   return "|";  case XOR:   return "^";  case AND: return "&&";
+    case OR:   return "||"; case EQ:    return "=="; case NEQ: return "!=";
+    case GE_U: return ">="; case LT_U:  return "<";  case MUL: return "*";
+    case DIV_U: return "/";
   }
-  assert(false);
+  return NULL;
+}
+
+// Emit the C for code[i] to f, or (if f is NULL) only check that it can be.
+#define AO(...) do { if(f) fprintf(f, __VA_ARGS__); } while(0)
+static bool aotInstr(Aot* a, FILE* f, TyFn* fn, U2 i) {
+  U1* code = fn->code; U1 instr = code[i]; U1* lit = code + i + 1;
+  U1 base = ~SZ_MASK & instr, szI = SZ_MASK & instr;
+  U1 sz = (szI > SZ4) ? 0 : szIToSz(szI); // only valid for sized instrs
+  const char* t = aotTy[szI >> 4]; const char* op;
+  if(instr >= SLIT) { AO("WS_ADD(%u);", 0x3F & instr); return true; }
+  if((op = aotBinOp(instr))) {
+    AO("{ S r = WS_POP(); WS_ADD(WS_POP() %s r); }", op); return true;
+  }
+  switch(instr) {
+    case NOP: return true;
+    case RET:  AO("goto done;"); return true;
+    case RETZ: AO("if(!WS_POP()) goto done;"); return true;
+    case SWP:  AO("{ WS_POP2(S a, S b); WS_ADD2(b, a); }"); return true;
+    case DRP:  AO("WS_POP();"); return true;
+    case OVR:  AO("{ WS_POP2(S a, S b); WS_ADD3(a, b, a); }"); return true;
+    case DUP:  AO("{ S a = WS_POP(); WS_ADD2(a, a); }"); return true;
+    case DUPN: AO("{ S a = WS_POP(); WS_ADD2(a, 0 == a); }"); return true;
+    case LR:   AO("WS_ADD((S)(l + %u));", ftBE(lit, 2)); return true;
+    case LRCLR: AO("memset(l + %u, 0, %u);", ftBE(lit, 2), ftBE(lit + 2, 2));
+                return true;
+    case ADDLL: AO("WS_ADD(*(U4*)(l + %u) + *(U4*)(l + %u));",
+                   ftBE(lit, 2), ftBE(lit + 2, 2)); return true;
+    case INC:  AO("WS_ADD(WS_POP() + 1);"); return true;
+    case INC2: AO("WS_ADD(WS_POP() + 2);"); return true;
+    case INC4: AO("WS_ADD(WS_POP() + 4);"); return true;
+    case DEC:  AO("WS_ADD(WS_POP() - 1);"); return true;
+    case ADDI: AO("WS_ADD(WS_POP() + %u);", *lit); return true;
+    case INV:  AO("WS_ADD(~WS_POP());"); return true;
+    case NEG:  AO("WS_ADD(-WS_POP());"); return true;
+    case NOT:  AO("WS_ADD(0 == WS_POP());"); return true;
+    case CI1:  AO("WS_ADD((I4)(I1)WS_POP());"); return true;
+    case CI2:  AO("WS_ADD((I4)(I2)WS_POP());"); return true;
+    case GE_S: AO("{ S r = WS_POP(); WS_ADD((I4)WS_POP() >= (I4)r); }"); return true;
+    case LT_S: AO("{ S r = WS_POP(); WS_ADD((I4)WS_POP() < (I4)r); }"); return true;
+    case DIV_S:
+      AO("{ WS_POP2(S a, S b); ASSERT(b, \"Div zero\"); WS_ADD((I4)a / (I4)b); }");
+      return true;
+    case GR: {
+      I4 r = aotRef(a, (Ty*)ftBE(lit, 4)); if(r < 0) return false;
+      AO("WS_ADD((S)((U1*)((TyVar*)aot_r[%u])->v + %u));", r, ftBE(lit + 4, 2));
+      return true;
+    }
+    case XL: case XLT: {
+      TyFn* callee = tyFn((Ty*)ftBE(lit, 4));
+      I4 r = aotFnI(a, callee);
+      if((r >= 0) and (XLT == instr)) { AO("ret(k); aot_%u(k); return;", r); return true; }
+      if(r >= 0) { AO("aot_%u(k);", r); return true; }
+      if(not isFnNative(callee) or (r = aotRef(a, (Ty*)callee)) < 0) return false;
+      AO("xImpl(k, aot_r[%u]);", r); return true;
+    }
+  }
+  if(instr < 0x40) return false;
+  if(instr < 0x80) switch(base) {
+    case FT:   AO("WS_ADD(*(%s*)WS_POP());", t); return true;
+    case FTBE: AO("WS_ADD(ftBE((U1*)WS_POP(), %u));", sz); return true;
+    case FTO:  AO("WS_ADD(*(%s*)(WS_POP() + %u));", t, *lit); return true;
+    case FTLL: AO("WS_ADD(*(%s*)(l + %u));", t, ftBE(lit, 2)); return true;
+    case SR:   AO("{ WS_POP2(S a, S b); *(%s*)a = b; }", t); return true;
+    case SRBE: AO("{ WS_POP2(S a, S b); srBE((U1*)a, %u, b); }", sz); return true;
+    case SRO:  AO("{ WS_POP2(S a, S b); *(%s*)(a + %u) = b; }", t, *lit); return true;
+    case SRLL: AO("*(%s*)(l + %u) = WS_POP();", t, ftBE(lit, 2)); return true;
+    case LIT:  AO("WS_ADD(0x%X);", ftBE(lit, sz)); return true;
+    case FTLO: AO("WS_ADD(*(%s*)(*(U4*)(l + %u) + %u));", t, ftBE(lit, 2), lit[2]);
+               return true;
+    case SRFTLL: AO("*(%s*)(l + %u) = WS_POP(); WS_ADD(*(%s*)(l + %u));",
+                    t, ftBE(lit, 2), t, ftBE(lit + 2, 2)); return true;
+    case FTGL: case SRGL: {
+      I4 r = aotRef(a, (Ty*)ftBE(lit, 4)); if(r < 0) return false;
+      if(FTGL == base) AO("WS_ADD(*(%s*)", t); else AO("*(%s*)", t);
+      AO("((U1*)((TyVar*)aot_r[%u])->v + %u)", r, ftBE(lit + 4, 2));
+      if(FTGL == base) AO(");"); else AO(" = WS_POP();");
+      return true;
+    }
+    default: return false;
+  }
+  if((instr == JW) or (instr == XLL) or (instr == XRL)) return false;
+  if(JTBL == base) {
+    AO("switch(WS_POP()) {");
+    for(U4 e = 0; e < ftBE(lit, sz); e++) {
+      I4 to = jtblTarget(code, i, e);
+      if((to < 0) or (to > fn->len)) return false;
+      if(to == fn->len) AO(" case %u: goto done;", e);
+      else              AO(" case %u: goto L%u;", e, to);
+    }
+    AO(" }"); return true;
+  }
+  if(SLIC == base) {
+    U4 len = ftBE(lit, sz);
+    if(f) { fprintf(f, "WS_ADD2((S)"); aotStr(f, lit + sz, len); }
+    AO(", %u);", len); return true;
+  }
+  if((SZ4 == (SZ_MASK & instr))
+     or ((JL != base) and (JLZ != base) and (JLZK != base) and (JNE != base)))
+    return false;
+  I4 to = jmpTarget(code, i);
+  if((to < 0) or (to > fn->len)) return false;
+  switch(base) {
+    case JLZ:  AO("if(!WS_POP()) "); break;
+    case JLZK: AO("if(!Stk_top(WS)) "); break;
+    case JNE:  AO("{ WS_POP2(S a, S b); if(a != b) "); break;
+  }
+  if(to == fn->len) AO("goto done;"); else AO("goto L%u;", to);
+  if(JNE == base) AO(" }");
+  return true;
+}
+#undef AO
+
+// Emit fn to f, or (if f is NULL) only check that it can be.
+static bool aotFn(Aot* a, FILE* f, TyFn* fn) {
+  U1* code = fn->code; U2 len = fn->len;
+  bool start[len + 1], target[len + 1];
+  memset(start, 0, sizeof(start)); memset(target, 0, sizeof(target));
+  for(U2 i = 0; i < len; i = instrNext(code, i)) {
+    start[i] = true;
+    U1 base = ~SZ_MASK & code[i];
+    if((code[i] < SLIT) and (code[i] >= 0x80) and (SZ4 != (SZ_MASK & code[i]))
+       and ((JL == base) or (JLZ == base) or (JLZK == base) or (JNE == base))) {
+      I4 to = jmpTarget(code, i);
+      if((to >= 0) and (to < len)) target[to] = true;
+    } else if(JTBL == base) {
+      for(U4 e = 0; e < ftBE(code + i + 1, szIToSz(code[i])); e++) {
+        I4 to = jtblTarget(code, i, e);
+        if((to >= 0) and (to < len)) target[to] = true;
+      }
+    }
+  }
+  for(U2 i = 0; i < len; i++) if(target[i] and not start[i]) return false;
+  U2 fnI = aotFnI(a, fn);
+  if(f) {
+    fprintf(f, "\nstatic void aot_%u(Kern* k) { // %.*s\n", fnI, Ty_fmt(fn));
+    if(fn->lSlots) fprintf(f, "  U1* l = fnEnter(k, aot_f[%u]);\n", fnI);
+    else           fprintf(f, "  fnEnter(k, aot_f[%u]);\n", fnI);
+  }
+  for(U2 i = 0; i < len; i = instrNext(code, i)) {
+    if(f) {
+      if(target[i]) fprintf(f, "L%u:\n", i);
+      fprintf(f, "  ");
+    }
+    if(not aotInstr(a, f, fn, i)) return false;
+    if(f) fprintf(f, "\n");
+  }
+  if(f) fprintf(f, "done:\n  ret(k);\n}\n");
+  return true;
+}
+
+U2 Kern_aot(Kern* k, FILE* f, TyDict* dict, char* name) {
+  CBst* root = TyDict_bst(dict);
+  TyFn* fns[aotCount(root) + 1];
+  Aot a = { .k = k, .dict = dict, .fns = fns };
+  aotCollect(&a, root);
+  U4 refCap = 1;
+  for(U2 i = 0; i < a.len; i++) refCap += a.fns[i]->len / 5; // XL/GR/etc >= 5
+  Ty* refs[refCap]; a.refs = refs;
+  for(bool changed = true; changed; ) { // drop fns which can't be emitted
+    changed = false;
+    for(U2 i = 0; i < a.len; i++) {
+      a.refLen = 0;
+      if(aotFn(&a, NULL, a.fns[i])) continue;
+      a.fns[i--] = a.fns[--a.len]; changed = true;
+    }
+  }
+  a.refLen = 0;
+  for(U2 i = 0; i < a.len; i++) aotFn(&a, NULL, a.fns[i]); // collect refs
+
+  fprintf(f, "// Generated by Kern_aot, do not edit.\n"
+             "// Call %s_load(k, dict) after compiling the fngi source of dict.\n"
+             "#include \"fngi.h\"\n\n", name);
+  fprintf(f, "static TyFn* aot_f[%u];\nstatic Ty* aot_r[%u];\n", a.len + 1, a.refLen + 1);
+  for(U2 i = 0; i < a.len; i++) fprintf(f, "static void aot_%u(Kern* k);\n", i);
+  for(U2 i = 0; i < a.len; i++) aotFn(&a, f, a.fns[i]);
+
+  fprintf(f, "\nstatic AotFn aot_fns[] = {\n");
+  for(U2 i = 0; i < a.len; i++) {
+    TyFn* fn = a.fns[i];
+    fprintf(f, "  { (CStr*)");  aotStr(f, (U1*)fn->bst.key, 1 + CStr_asSlc(fn->bst.key).len);
+    fprintf(f, ", aot_%u, &aot_f[%u], %u, %u },\n", i, i, fn->len, fn->lSlots);
+  }
+  fprintf(f, "  {0}\n};\n\nstatic AotRef aot_refs[] = {\n");
+  for(U2 i = 0; i < a.refLen; i++) {
+    CStr* key = a.refs[i]->bst.key;
+    fprintf(f, "  { (CStr*)"); aotStr(f, (U1*)key, 1 + CStr_asSlc(key).len);
+    fprintf(f, ", %s },\n", isTyFn(a.refs[i]) ? "true" : "false");
+  }
+  fprintf(f, "  {0}\n};\n\n"
+             "U2 %s_load(Kern* k, TyDict* dict) {\n"
+             "  return Kern_aotLoad(k, dict, aot_fns, aot_refs, aot_r);\n"
+             "}\n", name);
+  return a.len;
 }
 
+U2 Kern_aotLoad(Kern* k, TyDict* dict, AotFn* fns, AotRef* refs, Ty** r) {
+  for(U2 i = 0; refs[i].name; i++) {
+    r[i] = aotFind(k, dict, refs[i].name);
+    ASSERT(r[i], "aot: symbol not found");
+  }
+  U2 n = 0;
+  for(; fns[n].name; n++) {
+    Ty* ty = TyDict_find(dict, CStr_asSlc(fns[n].name));
+    ASSERT(ty, "aot: fn not found");
+    TyFn* fn = tyFn(ty);
+    ASSERT(not isFnNative(fn) and (fn->len == fns[n].len)
+           and (fn->lSlots == fns[n].lSlots), "aot: fn differs from its source");
+    *fns[n].fn = fn;
+  }
+  for(U2 i = 0; i < n; i++) {
+    TyFn* fn = *fns[i].fn;
+    fn->meta |= TY_FN_NATIVE; fn->code = (U1*)fns[i].c;
+  }
+  for(U2 i = 0; refs[i].name; i++) {
+    ASSERT(not refs[i].call or isFnNative(tyFn(r[i])), "aot: callee not native");
+  }
+  return n;
+}
+
+// ***********************
+// * 3: TyDb, the type database and validator
+// The type database is a stack of TyI Singly Linked Lists.
+// Whenever a function is called, it's inputs are popped from the top SLL and
+// the outputs are added.
+// If statements/etc utilize split/merge operations.
+
+TYIS(/*extern*/) // global TyI and TyIs, see fngi.h. Ty_* are in builtins.inc
+
+TyI TyIs_UNSET  = { .ty = (Ty*)&Ty_UNSET  };
+TyI TyIs_Unsafe = { .ty = (Ty*)&Ty_Unsafe };
+TyI TyIs_rAny   = { .ty = (Ty*)&Ty_Any, .meta = 1 };
+TyI TyIs_rAnyS  = { .ty = (Ty*)&Ty_S, .next = &TyIs_rAny };
+TyI TyIs_rAnySS = { .ty = (Ty*)&Ty_S, .next = &TyIs_rAnyS };
+
+TyI TyIs_S    = { .ty = (Ty*)&Ty_S };
+TyI TyIs_SS   = { .next = &TyIs_S,  .ty = (Ty*)&Ty_S };
+TyI TyIs_SSS  = { .next = &TyIs_SS, .ty = (Ty*)&Ty_S };
+TyI TyIs_U1   = { .ty = (Ty*)&Ty_U1 };
+TyI TyIs_U2   = { .ty = (Ty*)&Ty_U2 };
+TyI TyIs_U4   = { .ty = (Ty*)&Ty_U4 };
+TyI TyIs_U4x2 = { .next = &TyIs_U4, .ty = (Ty*)&Ty_U4 };
+TyI TyIs_rU1  = { .ty = (Ty*)&Ty_U1, .meta = 1 };
+TyI TyIs_rU2  = { .ty = (Ty*)&Ty_U2, .meta = 1 };
+TyI TyIs_rU4  = { .ty = (Ty*)&Ty_U4, .meta = 1 };
+TyI TyIs_rU1_U4 = { .ty = (Ty*)&Ty_U4, .next = &TyIs_rU4 };
+TyI TyIs_Chan   = { .ty = (Ty*)&Ty_Chan };
+TyI TyIs_ChanS  = { .ty = (Ty*)&Ty_S, .next = &TyIs_Chan };
+
 S TyDict_size(TyDict* ty) {
   ASSERT(not isDictMod(ty), "attempted size of TY_DICT_MOD");
   if(isDictNative(ty)) return szIToSz((S)ty->children);
@@ -474,13 +1915,13 @@ Ty* TyDict_find(TyDict* dict, Slc s) {
 }
 
 Ty* TyDict_scanTy(Kern* k, TyDict* dict) {
-    scan(k); Ty* ty = TyDict_find(dict, tokenSlc(k));
+    scan(k); Ty* ty = Kern_findIn(k, dict, tokenSlc(k));
     if(not ty) return NULL;
     tokenDrop(k); return ty;
 }
 
-TyVar* TyDict_field(TyDict* d, TyI* field) {
-  TyVar* var = (TyVar*) TyDict_find(d, CStr_asSlc(field->name));
+TyVar* TyDict_field(Kern* k, TyDict* d, TyI* field) {
+  TyVar* var = (TyVar*) TyDict_findName(k, d, field->name);
   assert(var && isTyVar((Ty*)var) && not isVarGlobal(var));
   return var;
 }
@@ -529,25 +1970,6 @@ TyI* TyI_cloneNode(TyI* node, BBA* bba) {
   return cloned;
 }
 
-void TyI_cloneAddNode(BBA* bba, TyI** root, TyI* node) {
-  Sll_add((Sll**)root, TyI_asSll(TyI_cloneNode(node, bba)));
-}
-
-// Clone from bottom to top, pushing onto root.
-// The result will be in the same order.
-// This is done so that freeing is done from top to bottom.
-void  TyI_cloneAdd(BBA* bba, TyI** root, TyI* nodes) {
-  if(not nodes) return;
-  TyI_cloneAdd(bba, root, nodes->next);
-  TyI_cloneAddNode(bba, root, nodes);
-}
-
-TyI* TyI_copy(BBA* bba, TyI* nodes) {
-  TyI* root = NULL;
-  TyI_cloneAdd(bba, &root, nodes);
-  return root;
-}
-
 void Kern_typed(Kern *k, bool typed) {
   if(typed) k->g.fnState &= ~C_UNTY;
   else      k->g.fnState |= C_UNTY;
@@ -563,9 +1985,8 @@ void dbgTyIs(Kern* k, TyDb* db) {
 void TyDb_print(Kern* k, TyDb* db) { TyI_printAll(TyDb_top(db)); }
 
 void TyDb_pop(Kern* k, TyDb* db) {
-  Sll** root = TyDb_rootSll(db);
-  Slc* err = BBA_free(db->bba, Sll_pop(root), sizeof(TyI), RSIZE);
-  if(err) SET_ERR(*err);
+  TyI** root = TyDb_root(db); ASSERT(*root, "TyDb_pop: empty");
+  *root = (*root)->next;
 }
 
 void TyDb_free(Kern* k, TyDb* db, TyI* stream) {
@@ -575,21 +1996,50 @@ void TyDb_free(Kern* k, TyDb* db, TyI* stream) {
   }
 }
 
+void TyDb_new(TyDb* db) {
+  TySnap* s = db->free;
+  if(s) db->free = s->next;
+  else { s = BBA_alloc(db->bba, sizeof(TySnap), RSIZE); ASSERT(s, "TyDb_new OOM"); }
+  *s = (TySnap) { .next = db->snap }; db->snap = s; db->len += 1;
+}
+
 void TyDb_drop(Kern* k, TyDb* db) {
-  TyDb_free(k, db, TyDb_top(db));
-  Stk_pop(&db->tyIs);
-  Stk_pop(&db->done);
+  TySnap* s = db->snap; ASSERT(s, "TyDb_drop: empty");
+  db->snap = s->next; s->next = db->free; db->free = s; db->len -= 1;
 }
 
-// Drop the item below the top of stack while still preserving proper drop order.
-// Note: This uses bbaDict to temporarily store the top value.
+// Drop the item below the top of stack.
 void TyDb_nip(Kern* k, TyDb* db) {
-  TyI* top = NULL; TyI_cloneAdd(k->g.bbaDict, &top, TyDb_top(db));
+  TyI* top = TyDb_top(db);
   TyDb_drop(k, db); TyDb_drop(k, db); // drop both top and second
-  TyDb_new(db); // re-add top
-  TyI_cloneAdd(db->bba, TyDb_root(db), top);
-  assert(not Sll_free((Sll*)top, sizeof(TyI), BBA_asArena(k->g.bbaDict)));
-  assert(not TyDb_done(db));
+  TyDb_new(db); *TyDb_root(db) = top; // re-add top
+}
+
+static U4 tyIHash(TyI* node, TyI* next) {
+  U4 h = (S)node->ty ^ ((S)node->name * 31) ^ ((S)next * 17) ^ node->meta;
+  h ^= h >> 13; h *= 0x5BD1E995; return h ^ (h >> 15);
+}
+static U4 tyIInternHash(U1* e) { TyI* t = *(TyI**)e; return tyIHash(t, t->next); }
+
+TyI* TyI_intern(Kern* k, TyI* node, TyI* next) {
+  Tbl* tbl = &k->g.tyIIntern; Tbl_reserve(k, tbl, tyIInternHash);
+  TyI** s;
+  for(U4 h = tyIHash(node, next); *(s = (TyI**)Tbl_at(tbl, h)); h++) {
+    TyI* t = *s;
+    if((t->ty == node->ty) and (t->name == node->name)
+       and (t->meta == node->meta) and (t->next == next)) return t;
+  }
+  TyI* t = BBA_alloc(k->g.bbaDict, sizeof(TyI), RSIZE); ASSERT(t, "TyI_intern OOM");
+  *t = (TyI) { .next = next, .meta = node->meta, .name = node->name, .ty = node->ty };
+  *s = t; tbl->len += 1;
+  return t;
+}
+
+// Push nodes onto root, from bottom to top so the result is in the same order.
+static void TyI_pushAll(Kern* k, TyI** root, TyI* nodes) {
+  if(not nodes) return;
+  TyI_pushAll(k, root, nodes->next);
+  *root = TyI_intern(k, nodes, *root);
 }
 
 void tyNotMatch(TyI* require, TyI* given) {
@@ -599,6 +2049,7 @@ void tyNotMatch(TyI* require, TyI* given) {
 
 // Check two type stacks.
 void tyCheck(TyI* require_, TyI* given_, bool sameLen, Slc errCxt) {
+  if(require_ == given_) return; // interned, so identical
   TyI* require = require_, *given = given_;
   S i = 0;
   while(require) {
@@ -636,7 +2087,7 @@ void tyCall(Kern* k, TyDb* db, TyI* inp, TyI* out) {
   TyI** root = TyDb_root(db);
   tyCheck(inp, *root, false, err);
   TyDb_free(k, db, inp);
-  TyI_cloneAdd(db->bba, root, out);
+  TyI_pushAll(k, root, out);
 }
 
 // Check function return type and possibly mark as done.
@@ -651,13 +2102,12 @@ void tyRet(Kern* k, TyDb* db, bool done) {
 void tyClone(Kern* k, TyDb* db, U2 depth) {
   if(IS_UNTY) return;
   TyI* stream = TyDb_index(db, depth);
-  TyDb_new(db);
-  if(stream) TyI_cloneAdd(db->bba, TyDb_root(db), stream);
+  TyDb_new(db); *TyDb_root(db) = stream; // interned, so shared
 }
 
 void tyMerge(Kern* k, TyDb* db) {
   if(IS_UNTY) return;
-  ASSERT(Stk_len(&db->tyIs) > 1, "tyMerge with 1 or fewer snapshots");
+  ASSERT(db->len > 1, "tyMerge with 1 or fewer snapshots");
   if(not TyDb_done(db)) {
     tyCheck(TyDb_index(db, 1), TyDb_top(db), true,
             SLC("Type error during merge (i.e. if/else)"));
@@ -721,6 +2171,7 @@ void skipWhitespace(Kern* k, SpReader f) {
 void scanRaw(Kern* k) {
   Buf* b = &k->g.token;
   if(b->len) return; // does nothing if token wasn't cleared.
+  k->g.tokenTyOk = false;
   SpReader f = k->g.src;
   skipWhitespace(k, f);
   U1* c = SpReader_get(k, f, 0); if(c == NULL) return;
@@ -740,7 +2191,7 @@ void scanRaw(Kern* k) {
 
 // Scan a line into token
 void scanLine(Kern* k) {
-  SpReader f = k->g.src; Buf* b = &k->g.token;
+  SpReader f = k->g.src; Buf* b = &k->g.token; k->g.tokenTyOk = false;
   for(U2 i = 0; true; i++) {
     U1* c = SpReader_get(k, f, b->len);
     if((NULL == c) or ('\n' == *c)) return;
@@ -752,7 +2203,7 @@ void scanLine(Kern* k) {
 void tokenDrop(Kern* k) {
   Buf* b = &k->g.token;
   Ring_incHead(&SpReader_asBase(k, k->g.src)->ring, b->len);
-  Buf_clear(b);
+  Buf_clear(b); k->g.tokenTyOk = false;
 }
 
 static inline bool tokenEq(Kern* k, Slc s) {
@@ -802,21 +2253,160 @@ ParsedNumber parseU4(Slc t) {
 // ***********************
 // * 5: Compiler
 
-static inline void Kern_compFn(Kern* k) { executeFn(k, k->g.compFn); }
+static inline void Kern_compFn(Kern* k) { executeFn(k, k->g.compFn); }
+
+void N_memclr(Kern* k) { // mem:&U1, len:U4
+  U4 len = WS_POP(); memset((void*)WS_POP(), 0, len);
+}
+TyFn TyFn_memclr; // builtin, see gen/builtins.inc
+
+// ***********************
+//   * peephole
+// Every op compiled below goes through peep, which fuses common sequences of
+// ops (chosen from measured instr pair counts) into one fused instr, see
+// spor.zty, and folds pure ops over literals into a single literal. Only ops
+// inside the window are rewritten, so a jmp may only be the last op of a
+// sequence and any jmp target (label) must call peepReset. Bytes added to code
+// without peep simply end the window.
+
+void peepReset(Kern* k) { k->g.peep = (Peep) {0}; }
+
+// If c is a literal op (SLIT/LIT) then get it's value.
+static bool peepLit(U1* c, U4* v) {
+  if(*c >= SLIT)           { *v = 0x3F & *c; return true; }
+  if(not isMemOp(*c, LIT)) return false;
+  *v = ftBE(c + 1, szIToSz(*c)); return true;
+}
+
+static void litAdd(Buf* b, U4 v) {
+  if (v <= SLIT_MAX)    { Buf_add(b, SLIT | v); }
+  else if (v <= 0xFF)   { Buf_add(b, SZ1 | LIT); Buf_add(b, v); }
+  else if (v <= 0xFFFF) { Buf_add(b, SZ2 | LIT); Buf_addBE2(b, v); }
+  else                  { Buf_add(b, SZ4 | LIT); Buf_addBE4(b, v); }
+}
+
+// Compute the pure op applied to literals (r is the top). Ops which would
+// panic or are undefined in C (shifts >= 32) are left for runtime.
+static bool foldUnary(U1 op, U4 r, U4* v) {
+  switch(op) {
+    case INC:  *v = r + 1; return true;
+    case INC2: *v = r + 2; return true;
+    case INC4: *v = r + 4; return true;
+    case DEC:  *v = r - 1; return true;
+    case INV:  *v = ~r;    return true;
+    case NEG:  *v = -r;    return true;
+    case NOT:  *v = 0 == r;          return true;
+    case CI1:  *v = (I4) ((I1) r);   return true;
+    case CI2:  *v = (I4) ((I2) r);   return true;
+  }
+  return false;
+}
+
+static bool foldBinary(U1 op, U4 l, U4 r, U4* v) {
+  switch(op) {
+    case ADD:   *v = l + r;  return true;
+    case SUB:   *v = l - r;  return true;
+    case MUL:   *v = l * r;  return true;
+    case MSK:   *v = l & r;  return true;
+    case JN:    *v = l | r;  return true;
+    case XOR:   *v = l ^ r;  return true;
+    case AND:   *v = l && r; return true;
+    case OR:    *v = l || r; return true;
+    case EQ:    *v = l == r; return true;
+    case NEQ:   *v = l != r; return true;
+    case GE_U:  *v = l >= r; return true;
+    case LT_U:  *v = l < r;  return true;
+    case GE_S:  *v = (I4)l >= (I4)r; return true;
+    case LT_S:  *v = (I4)l < (I4)r;  return true;
+    case SHL:   if(r >= 32) return false; *v = l << r; return true;
+    case SHR:   if(r >= 32) return false; *v = l >> r; return true;
+    case MOD:   if(not r)   return false; *v = l % r;  return true;
+    case DIV_U: if(not r)   return false; *v = l / r;  return true;
+    case DIV_S: if(not r)   return false; *v = (I4)l / (I4)r; return true;
+  }
+  return false;
+}
+
+// Replace the last n ops of the window with a single op, which the caller
+// then adds to the returned code.
+static Buf* peepFuse(Kern* k, U1 n) {
+  Peep* p = &k->g.peep; p->len -= n - 1;
+  k->g.code.len = p->i[p->len - 1];
+  return &k->g.code;
+}
+
+static void fuse(Kern* k) {
+  Peep* p = &k->g.peep; U1* c = k->g.code.dat; Buf* b;
+  if(p->len < 2) return;
+  U1* op = c + p->i[p->len - 1];
+  U1* o1 = c + p->i[p->len - 2];
+  U1* o2 = (p->len > 2) ? c + p->i[p->len - 3] : NULL;
+  U4 l, r, v;
+  if(peepLit(o1, &r)) { // constant folding
+    if(o2 and peepLit(o2, &l) and foldBinary(*op, l, r, &v)) {
+      return litAdd(peepFuse(k, 3), v);
+    }
+    if(foldUnary(*op, r, &v)) return litAdd(peepFuse(k, 2), v);
+  }
+  if(ADD == *op) {
+    if(o2 and (SZ4|FTLL) == *o2 and (SZ4|FTLL) == *o1) {
+      l = ftBE(o2 + 1, 2); r = ftBE(o1 + 1, 2);
+      b = peepFuse(k, 3); Buf_add(b, ADDLL); Buf_addBE2(b, l); Buf_addBE2(b, r);
+    } else if(o2 and (SZ4|SRFTLL) == *o2 and (SZ4|FTLL) == *o1) {
+      // split the SRFTLL (i.e. storing inputs) so its fetch is in the ADDLL
+      U2 sr = ftBE(o2 + 1, 2); l = ftBE(o2 + 3, 2); r = ftBE(o1 + 1, 2);
+      b = peepFuse(k, 3); Buf_add(b, SZ4|SRLL); Buf_addBE2(b, sr);
+      p->i[p->len++] = b->len;
+      Buf_add(b, ADDLL); Buf_addBE2(b, l); Buf_addBE2(b, r);
+    } else if(peepLit(o1, &r) and (r <= 0xFF)) {
+      b = peepFuse(k, 2); Buf_add(b, ADDI); Buf_add(b, r);
+    }
+  } else if((isMemOp(*op, FTO) or isMemOp(*op, FT)) and (SZR|FTLL) == *o1) {
+    U1 sz = SZ_MASK & *op; l = ftBE(o1 + 1, 2);
+    r = isMemOp(*op, FTO) ? op[1] : 0;
+    b = peepFuse(k, 2); Buf_add(b, sz | FTLO); Buf_addBE2(b, l); Buf_add(b, r);
+  } else if(isMemOp(*op, FTLL) and ((SZ_MASK & *op) | SRLL) == *o1) {
+    U1 sz = SZ_MASK & *op; l = ftBE(o1 + 1, 2); r = ftBE(op + 1, 2);
+    b = peepFuse(k, 2); Buf_add(b, sz | SRFTLL); Buf_addBE2(b, l); Buf_addBE2(b, r);
+  } else if((SZ2|JLZ) == *op and ((DUP == *o1) or (EQ == *o1))) {
+    U1 jmp = (DUP == *o1) ? JLZK : JNE; r = ftBE(op + 1, 2);
+    b = peepFuse(k, 2); Buf_add(b, SZ2 | jmp); Buf_addBE2(b, r);
+  } else if(XL == *op and ((S)&TyFn_memclr == ftBE(op + 1, 4))
+            and o2 and (LR == *o2) and peepLit(o1, &r) and (r <= 0xFFFF)) {
+    l = ftBE(o2 + 1, 2);
+    b = peepFuse(k, 3); Buf_add(b, LRCLR); Buf_addBE2(b, l); Buf_addBE2(b, r);
+  }
+}
+
+// Add the op just compiled at code[i] to the window and fuse it.
+void peep(Kern* k, U2 i) {
+  Peep* p = &k->g.peep; Buf* b = &k->g.code;
+  if((p->dat != b->dat) or (p->end != i)) p->len = 0; // new code or raw bytes
+  if(PEEP_DEPTH == p->len) {
+    for(U1 j = 1; j < PEEP_DEPTH; j++) p->i[j - 1] = p->i[j];
+    p->len -= 1;
+  }
+  p->i[p->len++] = i;
+  fuse(k);
+  p->dat = b->dat; p->end = b->len;
+}
 
-void N_memclr(Kern* k) { // mem:&U1, len:U4
-  U4 len = WS_POP(); memset((void*)WS_POP(), 0, len);
+// Whether the last op compiled was instr.
+bool peepLastIs(Kern* k, U1 instr) {
+  Peep* p = &k->g.peep; Buf* b = &k->g.code;
+  if(p->len and (p->dat == b->dat) and (p->end == b->len)) {
+    return instr == b->dat[p->i[p->len - 1]];
+  }
+  return instr == b->dat[b->len - 1];
 }
-TyFn TyFn_memclr = TyFn_native("\x06" "memclr", 0, (U1*)N_memclr, &TyIs_rU1_U4, TYI_VOID);
 
 // ***********************
 //   * lit / compileLit
 
-void lit(Buf* b, U4 v) {
-  if (v <= SLIT_MAX)    { Buf_add(b, SLIT | v); }
-  else if (v <= 0xFF)   { Buf_add(b, SZ1 | LIT); Buf_add(b, v); }
-  else if (v <= 0xFFFF) { Buf_add(b, SZ2 | LIT); Buf_addBE2(b, v); }
-  else                  { Buf_add(b, SZ4 | LIT); Buf_addBE4(b, v); }
+void lit(Kern* k, U4 v) {
+  Buf* b = &k->g.code; U2 i = b->len;
+  litAdd(b, v);
+  peep(k, i);
 }
 
 void compileLit(Kern* k, U4 v, bool asImm) {
@@ -824,7 +2414,7 @@ void compileLit(Kern* k, U4 v, bool asImm) {
   if(asImm) {
     return WS_ADD(v);
   }
-  lit(&k->g.code, v);
+  lit(k, v);
 }
 
 // ***********************
@@ -839,38 +2429,51 @@ void Buf_addSz(Buf* b, S v, U1 sz) {
   SET_ERR(SLC("Buf_addSz: sz"));
 }
 
-// sized operation with 1 byte literal (i.e. FTLL, SRLL, etc)
-void op1(Buf* b, U1 op, U1 sz, S v) {
+// operation with no literal (i.e. ADD, FT, etc)
+void op0(Kern* k, U1 op) {
+  Buf* b = &k->g.code; U2 i = b->len;
+  Buf_add(b, op);
+  peep(k, i);
+}
+
+// sized operation with 1 byte literal (i.e. FTO, SRO, etc)
+void op1(Kern* k, U1 op, U1 sz, S v) {
+  Buf* b = &k->g.code; U2 i = b->len;
   Buf_add(b, op | (SZ_MASK & sz));
   Buf_add(b, v);
+  peep(k, i);
 }
 
-void op2(Buf* b, U1 op, U1 szI, S v) {
+void op2(Kern* k, U1 op, U1 szI, S v) {
+  Buf* b = &k->g.code; U2 i = b->len;
   Buf_add(b, op | (SZ_MASK & szI));
   Buf_addBE2(b, v);
+  peep(k, i);
 }
 
-void op42(Buf* b, U1 op, U1 szI, S v4, S v2) {
+void op42(Kern* k, U1 op, U1 szI, S v4, S v2) {
+  Buf* b = &k->g.code; U2 i = b->len;
   Buf_add(b, op | (SZ_MASK & szI));
   Buf_addBE4(b, v4); Buf_addBE2(b, v2);
+  peep(k, i);
 }
 
 // Compile an operation offset
-void opCompile(Buf* b, U1 op, U1 szI, U2 offset, TyVar* global) {
+void opCompile(Kern* k, U1 op, U1 szI, U2 offset, TyVar* global) {
   assert(op != FT && op != SR);
   if(0 == offset) {
-    if     (FTO == op) return Buf_add(b, FT | (SZ_MASK & szI));
-    else if(SRO == op) return Buf_add(b, SR | (SZ_MASK & szI));
+    if     (FTO == op) return op0(k, FT | (SZ_MASK & szI));
+    else if(SRO == op) return op0(k, SR | (SZ_MASK & szI));
   }
-  if      (FTO  == op || SRO  == op) op1(b, op, szI, offset);
-  else if (FTLL == op || SRLL == op) op2(b, op, szI, offset);
-  else if (LR   == op) op2(b, LR, 0, offset);
+  if      (FTO  == op || SRO  == op) op1(k, op, szI, offset);
+  else if (FTLL == op || SRLL == op) op2(k, op, szI, offset);
+  else if (LR   == op) op2(k, LR, 0, offset);
   else if (FTGL == op || SRGL == op) {
     assert(global);
-    op42(b, op, szI, (S)global, offset);
+    op42(k, op, szI, (S)global, offset);
   } else if (GR   == op) {
     assert(global);
-    op42(b, GR, 0, (S)global, offset);
+    op42(k, GR, 0, (S)global, offset);
   }
   else assert(false);
 }
@@ -895,31 +2498,416 @@ void opImm(Kern* k, U1 op, U1 szI, U2 offset, TyVar* g) {
 // If 'b' is provided, then the operation is compiled. Else it is executed
 // immediately.
 void opOffset(Kern* k, Buf* b, U1 op, U1 szI, U2 offset, TyVar* g) {
-  if(b)  opCompile(b, op, szI, offset, g);
+  if(b)  opCompile(k, op, szI, offset, g);
   else   opImm(    k, op, szI, offset, g);
 }
 
 // Compile a call
 void opCall(Kern* k, TyFn* fn) {
-  Buf* b = &k->g.code; Buf_add(b, XL); Buf_addBE4(b, (S)fn);
+  Buf* b = &k->g.code; U2 i = b->len;
+  Buf_add(b, XL); Buf_addBE4(b, (S)fn);
+  peep(k, i);
+}
+
+// ***********************
+//   * optimizer
+// With k->g.opt >= 1 (-O1) N_fn passes the finished code of each fn to optFn,
+// which lifts it into a list of primitive ops (fused ops are split), rewrites
+// the list and re-emits it through peep, which folds and fuses it again.
+// Only locals whose address is never taken are tracked, and only within a
+// basic block (a label forgets everything) so every value has one known
+// definition without needing phi nodes. The rewrites are:
+// * folding: pure ops over literals become a literal.
+// * strength reduction: MUL/DIV_U/MOD by a power of 2 become SHL/SHR/MSK and
+//   identities (i.e. x+0, x*1) are removed.
+// * const/copy propagation: a fetch of a local which was stored from a literal
+//   or another local becomes that literal or a fetch of that local.
+// * dead stores: a store to a local which is never fetched, or is stored again
+//   before any fetch, becomes a DRP which is removed with its value.
+// * redundant loads: a FTLL, or a FTLL + FTO/FT field load, which repeats the
+//   load right before it becomes a DUP. So does a FTLL of the 4 byte local
+//   stored right before it (the store moves after the DUP).
+// Code with a JTBL, SLIC, LCL or 4 byte jmp is not optimized.
+
+typedef struct {
+  U1 op; U1 n;  // op and size of its literal
+  U4 v;         // literal (or a local's offset)
+  U1* raw;      // literal bytes, if not v
+  I2 to;        // the index jumped to, else -1
+  bool label;   // whether it is jumped to
+  bool dead;
+} OptI;
+
+// What is known about each local slot: a literal (isK) or a copy of a slot.
+typedef struct { I2 cp[OPT_SLOTS]; U4 v[OPT_SLOTS]; bool isK[OPT_SLOTS]; } OptLocals;
+
+static OptI* optAdd(OptI* ir, U2* n, U1 op, U4 v, U1 litSz) {
+  OptI* o = &ir[(*n)++];
+  *o = (OptI) { .op = op, .n = litSz, .v = v, .to = -1 };
+  return o;
+}
+
+// Lift code into primitive ops, returning how many or -1 if it can't be.
+// addr is set if the address of a local is taken.
+static I4 optLift(U1* c, U2 len, OptI* ir, bool* addr) {
+  U2 at[len + 1]; U2 n = 0;
+  memset(at, 0xFF, sizeof(at));
+  for(U2 i = 0; i < len; i = instrNext(c, i)) {
+    U1 instr = c[i], sz = SZ_MASK & instr; U1* l = c + i + 1; U4 v;
+    at[i] = n;
+    if(peepLit(c + i, &v)) optAdd(ir, &n, LIT, v, 0);
+    else if(ADDI == instr) {
+      optAdd(ir, &n, LIT, *l, 0); optAdd(ir, &n, ADD, 0, 0);
+    } else if(ADDLL == instr) {
+      optAdd(ir, &n, SZ4|FTLL, ftBE(l, 2), 2);
+      optAdd(ir, &n, SZ4|FTLL, ftBE(l + 2, 2), 2);
+      optAdd(ir, &n, ADD, 0, 0);
+    } else if(isMemOp(instr, SRFTLL)) {
+      optAdd(ir, &n, sz|SRLL, ftBE(l, 2), 2);
+      optAdd(ir, &n, sz|FTLL, ftBE(l + 2, 2), 2);
+    } else if(isMemOp(instr, FTLO)) {
+      optAdd(ir, &n, SZ4|FTLL, ftBE(l, 2), 2);
+      if(l[2]) optAdd(ir, &n, sz|FTO, l[2], 1);
+      else     optAdd(ir, &n, sz|FT, 0, 0);
+    } else if(isMemOp(instr, FTLL) or isMemOp(instr, SRLL)) {
+      optAdd(ir, &n, instr, ftBE(l, 2), 2);
+    } else if(isJmp(instr)) {
+      if(SZ4 == sz) return -1;
+      optAdd(ir, &n, SZ2 | (~SZ_MASK & instr), 0, 2)->to = jmpTarget(c, i);
+    } else if((JTBL == (~SZ_MASK & instr)) or (SLIC == (~SZ_MASK & instr))
+              or (LCL == instr) or (JW == instr)) {
+      return -1;
+    } else {
+      if((LR == instr) or (XLL == instr) or (XRL == instr) or (RG == instr)) *addr = true;
+      optAdd(ir, &n, instr, 0, instrLitSz(instr))->raw = l;
+    }
+  }
+  at[len] = n;
+  for(U2 i = 0; i < n; i++) {
+    if(ir[i].to < 0) continue;
+    if((ir[i].to > len) or (0xFFFF == at[ir[i].to])) return -1;
+    ir[i].to = at[ir[i].to];
+    if(ir[i].to < n) ir[ir[i].to].label = true;
+  }
+  return n;
+}
+
+// The index of the live op which runs right before ir[i], else -1.
+static I2 optPrev(OptI* ir, I2 i) {
+  if(ir[i].label) return -1;
+  for(i -= 1; (i >= 0) and ir[i].dead; i--) if(ir[i].label) return -1;
+  return i;
+}
+
+// The slot of a 4 byte local op, else -1.
+static I2 optSlot(OptI* o) {
+  if((SZ4 != (SZ_MASK & o->op)) or (o->v % RSIZE) or (o->v / RSIZE >= OPT_SLOTS)) {
+    return -1;
+  }
+  return o->v / RSIZE;
+}
+
+// Forget what is known about the locals at [off, off+len) and their copies.
+static void optForget(OptLocals* lc, U4 off, U4 len) {
+  for(U4 s = off / RSIZE; (s < OPT_SLOTS) and (s * RSIZE < off + len); s++) {
+    lc->isK[s] = false; lc->cp[s] = -1;
+    for(U1 j = 0; j < OPT_SLOTS; j++) if(s == lc->cp[j]) lc->cp[j] = -1;
+  }
+}
+
+// Whether ir[i] touches the locals at [off, off+len).
+static bool optTouches(OptI* o, U4 off, U4 len) {
+  U4 at, n;
+  if(isMemOp(o->op, FTLL) or isMemOp(o->op, SRLL)) {
+    at = o->v; n = szIToSz(o->op);
+  } else if(LRCLR == o->op) {
+    at = ftBE(o->raw, 2); n = ftBE(o->raw + 2, 2);
+  } else return false;
+  return (at < off + len) and (off < at + n);
+}
+
+static bool optFold(OptI* ir, U2 n) {
+  bool changed = false; U4 v;
+  for(I2 i = 0; i < n; i++) {
+    OptI* o = &ir[i]; if(o->dead) continue;
+    I2 p = optPrev(ir, i); if((p < 0) or (LIT != ir[p].op)) continue;
+    I2 pp = optPrev(ir, p); U4 r = ir[p].v;
+    if((pp >= 0) and (LIT == ir[pp].op) and foldBinary(o->op, ir[pp].v, r, &v)) {
+      ir[pp].v = v; ir[p].dead = o->dead = true;
+    } else if(foldUnary(o->op, r, &v)) {
+      ir[p].v = v; o->dead = true;
+    } else if(((0 == r) and ((ADD == o->op) or (SUB == o->op) or (JN == o->op)
+                         or (XOR == o->op) or (SHL == o->op) or (SHR == o->op)))
+              or ((1 == r) and ((MUL == o->op) or (DIV_U == o->op)))) {
+      ir[p].dead = o->dead = true;
+    } else if((r > 1) and not (r & (r - 1))
+              and ((MUL == o->op) or (DIV_U == o->op) or (MOD == o->op))) {
+      if(MOD == o->op) { ir[p].v = r - 1; o->op = MSK; }
+      else {
+        for(v = 0; r > 1; r >>= 1) v++;
+        ir[p].v = v; o->op = (MUL == o->op) ? SHL : SHR;
+      }
+    } else continue;
+    changed = true;
+  }
+  return changed;
+}
+
+static bool optProp(OptI* ir, U2 n) {
+  bool changed = false; OptLocals lc;
+  for(I2 i = 0; i < n; i++) {
+    OptI* o = &ir[i];
+    if((0 == i) or o->label) {
+      memset(lc.cp, 0xFF, sizeof(lc.cp)); memset(lc.isK, 0, sizeof(lc.isK));
+    }
+    if(o->dead) continue;
+    I2 s = optSlot(o);
+    if(isMemOp(o->op, FTLL) and (s >= 0)) {
+      if(lc.isK[s])          { o->op = LIT; o->v = lc.v[s]; changed = true; }
+      else if(lc.cp[s] >= 0) { o->v = lc.cp[s] * RSIZE;    changed = true; }
+    } else if(isMemOp(o->op, SRLL) or (LRCLR == o->op)) {
+      if(LRCLR == o->op) optForget(&lc, ftBE(o->raw, 2), ftBE(o->raw + 2, 2));
+      else               optForget(&lc, o->v, szIToSz(o->op));
+      I2 p = optPrev(ir, i); if((s < 0) or (p < 0)) continue;
+      I2 ps = optSlot(&ir[p]);
+      if(LIT == ir[p].op) { lc.isK[s] = true; lc.v[s] = ir[p].v; }
+      else if(isMemOp(ir[p].op, FTLL) and (ps >= 0) and (ps != s)) lc.cp[s] = ps;
+    }
+  }
+  return changed;
+}
+
+// Whether the store at ir[i] can be fetched before it is stored again.
+static bool optLive(OptI* ir, U2 n, I2 i, bool* fetched) {
+  I2 s = optSlot(&ir[i]);
+  if(s < 0)        return true;
+  if(not fetched[s]) return false;
+  for(i += 1; i < n; i++) {
+    OptI* o = &ir[i];
+    if(o->label or isJmp(o->op)) return true;
+    if(o->dead) continue;
+    if(RET == o->op) return false;
+    if(optTouches(o, s * RSIZE, RSIZE)) return optSlot(o) != s or not isMemOp(o->op, SRLL);
+  }
+  return true;
+}
+
+static bool optDeadStores(OptI* ir, U2 n) {
+  bool changed = false, fetched[OPT_SLOTS] = {0};
+  for(I2 i = 0; i < n; i++) {
+    OptI* o = &ir[i];
+    if(o->dead or not isMemOp(o->op, FTLL)) continue;
+    for(U4 s = o->v / RSIZE; (s < OPT_SLOTS) and (s * RSIZE < o->v + szIToSz(o->op)); s++) {
+      fetched[s] = true;
+    }
+  }
+  for(I2 i = 0; i < n; i++) {
+    OptI* o = &ir[i];
+    if(o->dead) continue;
+    if(isMemOp(o->op, SRLL) and not optLive(ir, n, i, fetched)) {
+      o->op = DRP; o->n = 0; changed = true;
+    } else if(DRP == o->op) { // drop a pure value which is then dropped
+      I2 p = optPrev(ir, i); if(p < 0) continue;
+      if((LIT == ir[p].op) or (DUP == ir[p].op) or isMemOp(ir[p].op, FTLL)) {
+        ir[p].dead = o->dead = true; changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+static bool optSame(OptI* a, OptI* b) { return (a->op == b->op) and (a->v == b->v); }
+static void optDup(OptI* o) { o->op = DUP; o->n = 0; o->v = 0; o->raw = NULL; }
+
+// Whether ir[i] is a field load (FTO or FT) of a FTLL, which is put in at.
+static bool optField(OptI* ir, I2 i, I2* at) {
+  if(not (isMemOp(ir[i].op, FTO) or isMemOp(ir[i].op, FT))) return false;
+  *at = optPrev(ir, i);
+  return (*at >= 0) and isMemOp(ir[*at].op, FTLL);
+}
+
+static bool optLoads(OptI* ir, U2 n) {
+  bool changed = false;
+  for(I2 i = 0; i < n; i++) {
+    OptI* o = &ir[i]; if(o->dead) continue;
+    I2 p, pp, ppp;
+    if(isMemOp(o->op, FTLL)) {
+      p = optPrev(ir, i); if(p < 0) continue;
+      if(optSame(o, &ir[p])) optDup(o);
+      else if((SZ4|SRLL) == ir[p].op and (SZ4|FTLL) == o->op and (o->v == ir[p].v)) {
+        o->op = ir[p].op; o->n = ir[p].n; optDup(&ir[p]);
+      } else continue;
+    } else if(optField(ir, i, &p)) {
+      pp = optPrev(ir, p);
+      if((pp < 0) or not optSame(o, &ir[pp]) or not optField(ir, pp, &ppp)
+         or not optSame(&ir[p], &ir[ppp])) continue;
+      ir[p].dead = true; optDup(o);
+    } else continue;
+    changed = true;
+  }
+  return changed;
+}
+
+// Re-emit the live ops into k->g.code through peep. Jmps are emitted as SZ2.
+static void optEmit(Kern* k, OptI* ir, U2 n) {
+  Buf* b = &k->g.code; U2 pos[n + 1], jmps[n], nj = 0;
+  peepReset(k);
+  for(U2 i = 0; i < n; i++) {
+    OptI* o = &ir[i];
+    if(o->label) peepReset(k);
+    pos[i] = b->len;
+    if(o->dead) continue;
+    if(LIT == o->op) { lit(k, o->v); continue; }
+    U2 at = b->len; Buf_add(b, o->op);
+    for(U1 j = 0; j < o->n; j++) {
+      Buf_add(b, o->raw ? o->raw[j] : (o->v >> (8 * (o->n - j - 1))));
+    }
+    peep(k, at);
+    // the jmp's literal stays at the end even if peep fused it
+    if(o->to >= 0) { jmps[nj++] = i; o->v = b->len - 2; }
+  }
+  pos[n] = b->len;
+  for(U2 j = 0; j < nj; j++) {
+    OptI* o = &ir[jmps[j]];
+    srBE(b->dat + o->v, 2, pos[o->to] - o->v);
+  }
+  peepReset(k);
+}
+
+// Optimize the finished code of a fn in place (-O1), see above.
+void optFn(Kern* k, Buf* code) {
+  U2 len = code->len; U1 c[len]; OptI ir[len * 3 + 1]; bool addr = false;
+  memcpy(c, code->dat, len);
+  I4 n = optLift(c, len, ir, &addr); if(n <= 0) return;
+  for(U1 round = 0; round < 8; round++) {
+    bool changed = optFold(ir, n) | optLoads(ir, n);
+    if(not addr) changed |= optProp(ir, n) | optDeadStores(ir, n);
+    if(not changed) break;
+  }
+  U1 dat[FN_ALLOC * 2]; Buf prev = *code;
+  *code = (Buf) { .dat = dat, .cap = sizeof(dat) };
+  optEmit(k, ir, n);
+  Buf out = *code; *code = prev;
+  if(out.len <= code->cap) { memcpy(code->dat, out.dat, out.len); code->len = out.len; }
 }
 
 // ***********************
 //   * scan / scanTy
 
-Ty* Kern_findTy(Kern* k, Slc t) { // You probably want to use scanTy
-  Ty* ty = NULL;
+// Names are interned in the Tbl k->g.names, so each Ty key and TyI name is a
+// unique CStr and compares by pointer. Dict children are also indexed by
+// {dict, name} in k->g.syms, so a lookup hashes the token once and then probes
+// each dict of dictStk by pointer. Both tables grow, so every name and child
+// is in them.
+//
+// The builtin dicts are constant and instead indexed by builtinSyms, which is
+// keyed by nameHash and generated by etc/gen.py. Their keys are interned first.
+static U4 nameHash(Slc s) { // FNV-1a
+  U4 h = 0x811C9DC5;
+  for(U2 i = 0; i < s.len; i++) h = (h ^ s.dat[i]) * 0x01000193;
+  return h;
+}
+
+// Get the builtin entry of s with hash h in d (any dict if NULL).
+static const Sym* builtinSym(TyDict* d, Slc s, U4 h) {
+  for(U2 i = 0; i < BUILTIN_TBL; i++) {
+    const Sym* y = &builtinSyms[(h + i) & (BUILTIN_TBL - 1)];
+    if(not y->ty) return NULL;
+    if(((not d) or (y->d == d)) and Slc_eq(s, CStr_asSlc(y->ty->bst.key))) return y;
+  }
+  return NULL;
+}
+
+static U4 nameEHash(U1* e) { return nameHash(CStr_asSlc(*(CStr**)e)); }
+
+// Get the entry of s, else the empty entry it would use (NULL if no table).
+static CStr** nameSlot(Kern* k, Slc s, U4 h) {
+  Tbl* t = &k->g.names; if(not t->blkLen) return NULL;
+  for(;; h++) {
+    CStr** y = (CStr**)Tbl_at(t, h);
+    if(not *y or Slc_eq(s, CStr_asSlc(*y))) return y;
+  }
+}
+
+static CStr* nameFind(Kern* k, Slc s, U4 h) {
+  const Sym* b = builtinSym(NULL, s, h);
+  if(b) return b->ty->bst.key;
+  CStr** y = nameSlot(k, s, h); return y ? *y : NULL;
+}
+
+// Get the interned CStr of s, interning key (or a new CStr if NULL) if it is new.
+CStr* Kern_intern(Kern* k, Slc s, CStr* key) {
+  U4 h = nameHash(s); CStr* n = nameFind(k, s, h);
+  if(n) return n;
+  Tbl_reserve(k, &k->g.names, nameEHash);
+  CStr** y = nameSlot(k, s, h);
+  if(not key) key = CStr_new(BBA_asArena(k->g.bbaDict), s);
+  ASSERT(key, "intern OOM");
+  *y = key; k->g.names.len += 1;
+  return key;
+}
+
+static U4 symHash(TyDict* d, CStr* n) {
+  U4 h = ((U4)(S)n ^ ((U4)(S)d << 7)) * 0x9E3779B1; return h ^ (h >> 16);
+}
+static U4 symEHash(U1* e) { Sym* y = (Sym*)e; return symHash(y->d, y->ty->bst.key); }
+
+// Get the entry of name n in d, else the empty entry it would use (NULL if no
+// table).
+static Sym* symFind(Kern* k, TyDict* d, CStr* n) {
+  Tbl* t = &k->g.syms; if(not t->blkLen) return NULL;
+  for(U4 h = symHash(d, n);; h++) {
+    Sym* y = (Sym*)Tbl_at(t, h);
+    if(not y->d or ((y->d == d) and (y->ty->bst.key == n))) return y;
+  }
+}
+
+// Find interned name n in d. h is the nameHash of n, only used for builtins.
+static Ty* dictFind(Kern* k, TyDict* d, CStr* n, U4 h) {
+  if(isDictBuiltin(d)) {
+    const Sym* b = builtinSym(d, CStr_asSlc(n), h);
+    return b ? b->ty : NULL;
+  }
+  Sym* y = symFind(k, d, n);
+  return y ? y->ty : NULL;
+}
+
+Ty* TyDict_findName(Kern* k, TyDict* d, CStr* n) {
+  if(not n) return NULL;
+  return dictFind(k, d, n, isDictBuiltin(d) ? nameHash(CStr_asSlc(n)) : 0);
+}
+
+Ty* Kern_findIn(Kern* k, TyDict* d, Slc s) {
+  U4 h = nameHash(s); CStr* n = nameFind(k, s, h);
+  return n ? dictFind(k, d, n, h) : NULL;
+}
+
+static Ty* findName(Kern* k, CStr* n, U4 h) {
   DictStk* dicts = &k->g.dictStk;
   for(U2 i = dicts->sp; i < dicts->cap; i++) {
-    ty = dicts->dat[i]->children;
-    I4 res = CBst_find((CBst**)&ty, t);
-    if((0 == res) && (ty != NULL)) return ty;
+    Ty* ty = dictFind(k, dicts->dat[i], n, h);
+    if(ty) return ty;
   }
   return NULL;
 }
 
-// You probably want to use scanTy
-Ty* Kern_findToken(Kern* k) { return Kern_findTy(k, *Buf_asSlc(&k->g.token)); }
+Ty* Kern_findName(Kern* k, CStr* n) {
+  return n ? findName(k, n, nameHash(CStr_asSlc(n))) : NULL;
+}
+
+Ty* Kern_findTy(Kern* k, Slc t) { // You probably want to use scanTy
+  U4 h = nameHash(t); CStr* n = nameFind(k, t, h);
+  return n ? findName(k, n, h) : NULL;
+}
+
+// You probably want to use scanTy. The result is kept until the token or the
+// dicts change.
+Ty* Kern_findToken(Kern* k) {
+  if(k->g.tokenTyOk and (k->g.tokenTyGen == k->g.dictStk.gen)) return k->g.tokenTy;
+  k->g.tokenTy = Kern_findTy(k, *Buf_asSlc(&k->g.token));
+  k->g.tokenTyGen = k->g.dictStk.gen; k->g.tokenTyOk = true;
+  return k->g.tokenTy;
+}
 
 // Scan, immediately executing comment functions
 void scan(Kern* k) {
@@ -937,8 +2925,15 @@ void Kern_addTy(Kern* k, Ty* ty) {
   ty->bst.l = NULL; ty->bst.r = NULL;
   DictStk* dicts = &k->g.dictStk;
   ASSERT(dicts->sp < dicts->cap, "No dicts");
-  Ty** root = &DictStk_top(dicts)->children;
-  ty = (Ty*)CBst_add((CBst**)root, (CBst*)ty);
+  TyDict* d = DictStk_top(dicts); Slc key = CStr_asSlc(ty->bst.key);
+  ASSERT(not isDictBuiltin(d), "builtin dicts are constant");
+  CStr* n = ty->bst.key = Kern_intern(k, key, ty->bst.key);
+  Tbl_reserve(k, &k->g.syms, symEHash);
+  Sym* y = symFind(k, d, n);
+  if(not y->d) k->g.syms.len += 1;
+  *y = (Sym) { .d = d, .ty = ty };
+  dicts->gen += 1;
+  ty = (Ty*)CBst_add((CBst**)&d->children, (CBst*)ty);
   if(ty) {
     eprintf("!! Overwritten key: %.*s\n", Dat_fmt(*ty->bst.key));
     SET_ERR(SLC("key was overwritten"));
@@ -1015,21 +3010,20 @@ void srOffset(Kern* k, TyI* tyI, U2 offset, SrOffset* st) {
                         // it may be re-used in next field.
   recSt.checkTy = false; recSt.clear = false; recSt.notParse = true;
   for(TyI* field = d->fields; field; field = field->next) {
-    srOffset(k, field, offset + TyDict_field(d, field)->v, &recSt);
+    srOffset(k, field, offset + TyDict_field(k, d, field)->v, &recSt);
   }
 }
 
 // Implementation of '{ ... }'
 void srOffsetStruct(Kern* k, TyDict* d, U2 offset, SrOffset* st) {
-  Buf* b = &k->g.code;
   // Clear memory first
   if(st->clear) {
     switch(st->op) {
-      case SRLL: op2(b, LR, 0, offset); break;
-      case SRO: Buf_add(b, DUP);        break;
+      case SRLL: op2(k, LR, 0, offset); break;
+      case SRO: op0(k, DUP);            break;
       default: assert(false);
     }
-    lit(b, d->sz);
+    lit(k, d->sz);
     opCall(k, &TyFn_memclr);
   }
   st->clear = false;
@@ -1094,12 +3088,73 @@ void _tyFtOffsetRefs(Kern* k, TyDb* db, TyI* tyI, FtOffset* st) {
   tyCall(k, db, NULL, tyI);
 }
 
+#define SET_FN_STATE(STATE)  k->g.fnState = bitSet(k->g.fnState, STATE, C_FN_STATE)
+#define IS_FN_STATE(STATE)   ((C_FN_STATE & k->g.fnState) == (STATE))
+
+// Get the end of the code to inline: the only RET must be the last instr
+// (native inline fns have none). Returns -1 if fn can't be inlined.
+static I4 inlineEnd(TyFn* fn) {
+  U1* c = fn->code;
+  for(U2 i = 0; i < fn->len; i = instrNext(c, i)) {
+    switch(c[i]) {
+      case RET:  return (instrNext(c, i) == fn->len) ? i : -1;
+      case RETZ: case LCL: return -1;
+    }
+  }
+  return fn->len;
+}
+
+// Whether to inline fn: inline fns and user fns no larger than INLINE_MAX.
+// A fn with locals can only be inlined into a fn (it uses the caller's frame).
+static bool inlineFn(Kern* k, TyFn* fn) {
+  if(not isFnInline(fn)) {
+    if(isFnNative(fn) or (fn->len > INLINE_MAX)) return false;
+  }
+  if(not fn->code or ((Ty*)fn == k->g.curTy)) return false; // recursive
+  if(fn->lSlots and not IS_FN_STATE(FN_STATE_BODY)) return false;
+  return inlineEnd(fn) >= 0;
+}
+
+static inline void inlineAdd2(U1* c, U2 base) { srBE(c, 2, ftBE(c, 2) + base); }
+
+// Move the locals offsets of the instr at c by base.
+static void inlineLocals(U1* c, U2 base) {
+  switch(*c) {
+    case LR: case XLL: case XRL: case LRCLR: return inlineAdd2(c + 1, base);
+    case ADDLL: inlineAdd2(c + 1, base); return inlineAdd2(c + 3, base);
+  }
+  if(isMemOp(*c, FTLL) or isMemOp(*c, SRLL) or isMemOp(*c, FTLO)) {
+    inlineAdd2(c + 1, base);
+  } else if(isMemOp(*c, SRFTLL)) {
+    inlineAdd2(c + 1, base); inlineAdd2(c + 3, base);
+  }
+}
+
+// Inline code is added op by op (so it can be fused) unless it has jmps. The
+// locals of fn are put after the caller's.
+void compileInline(Kern* k, TyFn* fn) {
+  Buf* b = &k->g.code; U1* c = fn->code; U2 end = inlineEnd(fn), base = 0;
+  if(fn->lSlots) {
+    base = align(k->g.fnLocals, RSIZE);
+    k->g.fnLocals = base + fn->lSlots * RSIZE;
+    ASSERT(k->g.fnLocals <= 0xFF * RSIZE, "inline: too many locals");
+  }
+  bool jmps = false;
+  for(U2 i = 0; i < end; i = instrNext(c, i)) jmps |= (0x80 == (0xC0 & c[i]));
+  for(U2 i = 0; i < end; i = instrNext(c, i)) {
+    U2 start = b->len;
+    Buf_extend(b, (Slc){c + i, .len=instrNext(c, i) - i});
+    if(XLT == b->dat[start]) b->dat[start] = XL; // no longer a tail call
+    if(base) inlineLocals(b->dat + start, base);
+    if(not jmps) peep(k, start);
+  }
+}
+
 void compileFn(Kern* k, TyFn* fn, bool asImm) {
   tyCall(k, tyDb(k, asImm), fn->inp, fn->out);
   if(asImm) return executeFn(k, fn);
-  Buf* b = &k->g.code;
-  if(isFnInline(fn)) return Buf_extend(b, (Slc){fn->code, .len=fn->len});
-  Buf_add(b, XL); Buf_addBE4(b, (U4)fn);
+  if(inlineFn(k, fn)) return compileInline(k, fn);
+  opCall(k, fn);
 }
 
 // Just pushes &self onto the stack and calls the method.
@@ -1157,7 +3212,7 @@ void ftOffset(Kern* k, TyI* tyI, U2 offset, FtOffset* st) {
 void ftOffsetStruct(Kern* k, TyDict* d, TyI* field, U2 offset, FtOffset* st) {
   if(not field) return;
   ftOffsetStruct(k, d, field->next, offset, st);
-  ftOffset(k, field, offset + TyDict_field(d, field)->v, st);
+  ftOffset(k, field, offset + TyDict_field(k, d, field)->v, st);
 }
 
 
@@ -1285,7 +3340,7 @@ void compileSrc(Kern* k) {
 Buf Kern_reserveCode(Kern* k, S sz) {
   Buf* code = &k->g.code;  Buf prevCode = *code;
   *code = Buf_new(BBA_asArena(&k->bbaCode), FN_ALLOC);
-  ASSERT(code->dat, "Code OOM");
+  ASSERT(code->dat, "Code OOM"); peepReset(k);
   return prevCode;
 }
 
@@ -1298,7 +3353,7 @@ void N_unty(Kern* k) {
   k->g.fnState &= ~C_UNTY;
 }
 
-void _N_ret(Kern* k) { tyRet(k, tyDb(k, false), true); Buf_add(&k->g.code, RET); }
+void _N_ret(Kern* k) { tyRet(k, tyDb(k, false), true); op0(k, RET); }
 void N_ret(Kern* k)  { N_notImm(k); Kern_compFn(k); _N_ret(k); }
 void N_tAssertEq(Kern* k) { WS_POP2(U4 l, U4 r); TASSERT_EQ(l, r); }
 void N_assertWsEmpty(Kern* k) {
@@ -1315,7 +3370,7 @@ void N_dbgRs(Kern* k) {
   for(U2 i = info->sp; i < info->cap; i++) {
     TyFn* fn = (TyFn*) info->dat[i];
     U1 lSlots = (fn == &catchTy) ? 0 : fn->lSlots;
-    eprintf("! - %.*s (%u bytes in)\n", Ty_fmt(fn), ep - fn->code);
+    eprintf("! - %.*s (%u bytes in)\n", Ty_fmt(fn), fnEpOffset(fn, ep));
     r += lSlots;
     ep = (U1*) rs->dat[r];
     r += RSIZE;
@@ -1385,6 +3440,8 @@ void _fnMetaNext(Kern* k, U2 meta) {
   k->g.metaNext |= meta;
 }
 
+void N_inline(Kern* k) { _fnMetaNext(k, TY_FN_INLINE); }
+
 TyDict* _locGet(Kern *k) {
   TyDict* next = (TyDict*) scanTy(k);
   ASSERT(next, "name not found");
@@ -1436,9 +3493,6 @@ void N_fnTy(Kern* k)   {
   k->g.metaNext |= (TY_FN_TY_MASK & meta);
 }
 
-#define SET_FN_STATE(STATE)  k->g.fnState = bitSet(k->g.fnState, STATE, C_FN_STATE)
-#define IS_FN_STATE(STATE)   ((C_FN_STATE & k->g.fnState) == (STATE))
-
 void synFnFound(Kern* k, Ty* ty) {
   ASSERT(isTyFn(ty) and isFnSyn((TyFn*)ty),
          "expect only syn functions in function signature");
@@ -1461,16 +3515,9 @@ void N_stk(Kern *k) {
   CONSUME(":");
   Sll_add(root, TyI_asSll(scanTyI(k)));
 }
-TyFn TyFn_stk = TyFn_native("\x03" "stk", TY_FN_SYN, (U1*)N_stk, TYI_VOID, TYI_VOID);
-
-CStr* scanDedupCStr(Kern* k) {
-  Ty* found = scanTy(k);
-  if(found) return found->bst.key;
-  else      return tokenCStr(k);
-}
 
 TyVar* varPre(Kern* k) {
-  CStr* key = scanDedupCStr(k);
+  CStr* key = tokenCStr(k);
   TyVar* var = (TyVar*) Ty_new(k, TY_VAR, key);
   REQUIRE(":");
   TyI* tyI = scanTyI(k);
@@ -1489,7 +3536,6 @@ void N_inp(Kern* k) {
   Sll_add(TyFn_inpRoot(tyFn(k->g.curTy)), TyI_asSll(tyI));
   localImpl(k, var);
 }
-TyFn TyFn_inp = TyFn_native("\x03" "inp", TY_FN_SYN, (U1*)N_inp, TYI_VOID, TYI_VOID);
 
 void _varGlobal(Kern* k, TyVar* v) {
   v->meta |= TY_VAR_GLOBAL;
@@ -1541,15 +3587,135 @@ void fnSignature(Kern* k, TyFn* fn) {
 void fnInputs(Kern* k, TyFn* fn) {
   TyDb* db = tyDb(k, false);
   for(TyI* tyI = fn->inp; tyI; tyI = tyI->next) {
-    TyVar* v = (TyVar*)Kern_findTy(k, CStr_asSlcMaybe(tyI->name));
+    TyVar* v = (TyVar*)Kern_findName(k, tyI->name);
     if(v and isTyVar((Ty*)v) and not isVarGlobal(v)) {
       SrOffset st = (SrOffset) { .op = SRLL, .checkTy = false, .notParse = true };
       srOffset(k, tyI, v->v, &st);
     }
     else if(/*isStk and*/ not IS_UNTY) {
-      TyI_cloneAddNode(db->bba, TyDb_root(db), tyI);
+      *TyDb_root(db) = TyI_intern(k, tyI, TyDb_top(db));
+    }
+  }
+}
+
+// Make calls in tail position (XL followed, possibly through JLs, by RET) into
+// XLT so they reuse the frame. Not done if the fn takes the address of a local
+// (LR, or a role's data for XLL/XRL) since the callee could still use it.
+void tailCalls(Buf* code) {
+  U1* c = code->dat; U2 len = code->len;
+  for(U2 i = 0; i < len; i = instrNext(c, i)) {
+    if((LR == c[i]) or (XLL == c[i]) or (XRL == c[i])) return;
+  }
+  for(U2 i = 0; i < len; i = instrNext(c, i)) {
+    if((XL != c[i]) or isFnNative((TyFn*)ftBE(c + i + 1, 4))) continue;
+    I4 j = instrNext(c, i);
+    for(U1 n = 0; (n < 8) and (j < len) and (c[j] < SLIT); n++) {
+      if((JL != (~SZ_MASK & c[j])) or (SZ4 == (SZ_MASK & c[j]))) break;
+      j = jmpTarget(c, j);
+      if((j < 0) or (j >= len)) break;
+    }
+    if((j >= 0) and (j < len) and (RET == c[j])) c[i] = XLT;
+  }
+}
+
+// Follow JLs from the instr at index t (bounded, they may loop).
+static I2 relaxChain(U1* c, U2* at, I2* to, U2 n, I2 t) {
+  for(U1 hop = 0; (hop < 8) and (t < n); hop++) {
+    U1 instr = c[at[t]];
+    if(not isJmp(instr) or (JL != (~SZ_MASK & instr))) break;
+    t = to[t];
+  }
+  return t;
+}
+
+static void relaxReach(bool* live, U2* work, U2* wlen, U2 n, U2 t) {
+  if((t < n) and not live[t]) { live[t] = true; work[(*wlen)++] = t; }
+}
+
+// Remove the code which can't be reached (i.e. after a ret), make SZ2 jmps and
+// table entries to a JL go to its target and shrink SZ2 jmps to SZ1 where the
+// offset fits. Nothing ever grows, so SZ1 offsets still fit after. Code with a
+// SZ4 jmp or table is left as is.
+void relaxJmps(Buf* code) {
+  U1* c = code->dat; U2 len = code->len, n = 0;
+  U2 ix[len + 1], at[len + 1], pos[len + 1], work[len + 1], wlen = 0;
+  I2 to[len + 1], ent[len + 1]; U1 sz[len + 1]; bool live[len + 1];
+  memset(ix, 0xFF, sizeof(ix));
+  for(U2 i = 0; i < len; i = instrNext(c, i)) { ix[i] = n; at[n++] = i; }
+  ix[len] = n; at[n] = len;
+
+  // Get the instr index of each jmp target (and table entry).
+  for(U2 j = 0; j < n; j++) {
+    U1 instr = c[at[j]]; to[j] = -1; sz[j] = 0;
+    bool jtbl = (instr < SLIT) and (JTBL == (~SZ_MASK & instr));
+    if(not isJmp(instr) and not jtbl) continue;
+    sz[j] = szIToSz(instr); if(4 == sz[j]) return;
+    if(not jtbl) {
+      I4 t = jmpTarget(c, at[j]);
+      if((t < 0) or (t > len) or (0xFFFF == ix[t])) return;
+      to[j] = ix[t]; continue;
+    }
+    for(U4 e = 0; e < ftBE(c + at[j] + 1, sz[j]); e++) {
+      I4 t = jtblTarget(c, at[j], e);
+      if((t < 0) or (t > len) or (0xFFFF == ix[t])) return;
+      ent[at[j] + 1 + sz[j] * (1 + e)] = ix[t];
+    }
+  }
+
+  // Collapse jmp chains. Only SZ2 so they can't overflow.
+  for(U2 j = 0; j < n; j++) {
+    if(2 != sz[j]) continue;
+    if(to[j] >= 0) { to[j] = relaxChain(c, at, to, n, to[j]); continue; }
+    for(U4 e = 0; e < ftBE(c + at[j] + 1, 2); e++) {
+      I2* t = &ent[at[j] + 3 + 2 * e]; *t = relaxChain(c, at, to, n, *t);
+    }
+  }
+
+  // Find the live instrs, following every jmp and fall through.
+  memset(live, 0, sizeof(live));
+  relaxReach(live, work, &wlen, n, 0);
+  while(wlen) {
+    U2 j = work[--wlen]; U1 instr = c[at[j]];
+    if(to[j] >= 0) relaxReach(live, work, &wlen, n, to[j]);
+    else if(sz[j]) for(U4 e = 0; e < ftBE(c + at[j] + 1, sz[j]); e++) {
+      relaxReach(live, work, &wlen, n, ent[at[j] + 1 + sz[j] * (1 + e)]);
+    }
+    // XLT falls through to its RET when it can't reuse the frame
+    if((RET == instr) or (isJmp(instr) and (JL == (~SZ_MASK & instr)))) continue;
+    relaxReach(live, work, &wlen, n, j + 1);
+  }
+
+  // Shrink jmps until nothing changes, then write the code.
+  for(bool changed = true; changed; ) {
+    changed = false; U2 p = 0;
+    for(U2 j = 0; j < n; j++) {
+      pos[j] = p;
+      if(live[j]) p += (to[j] >= 0) ? 1 + sz[j] : at[j + 1] - at[j];
+    }
+    pos[n] = p;
+    for(U2 j = 0; j < n; j++) {
+      if(not live[j] or (to[j] < 0) or (2 != sz[j])) continue;
+      I4 off = pos[to[j]] - (pos[j] + 1);
+      if((off >= -0x80) and (off <= 0x7F)) { sz[j] = 1; changed = true; }
+    }
+  }
+  U1 out[len];
+  for(U2 j = 0; j < n; j++) {
+    if(not live[j]) continue;
+    U1* o = out + pos[j]; U1 instr = c[at[j]];
+    if(to[j] >= 0) {
+      *o = ((1 == sz[j]) ? SZ1 : SZ2) | (~SZ_MASK & instr);
+      srBE(o + 1, sz[j], pos[to[j]] - (pos[j] + 1));
+      continue;
+    }
+    memcpy(o, c + at[j], at[j + 1] - at[j]);
+    if(not sz[j]) continue;
+    for(U4 e = 0; e < ftBE(o + 1, sz[j]); e++) {
+      U2 ea = pos[j] + 1 + sz[j] * (1 + e);
+      srBE(out + ea, sz[j], pos[ent[at[j] + 1 + sz[j] * (1 + e)]] - ea);
     }
   }
+  memcpy(c, out, pos[n]); code->len = pos[n];
 }
 
 // fn NAME do (... code ...)
@@ -1565,9 +3731,8 @@ void N_fn(Kern* k) {
 
   Buf* code = &k->g.code;  Buf prevCode = Kern_reserveCode(k, FN_ALLOC);
 
-  const U2 db_startLen = Stk_len(&k->g.tyDb.done);
-  TyDb_new(&k->g.tyDb);
-  LOCAL_TYDB_BBA(tyDb); TyDb* db = tyDb(k, false);
+  const U2 db_startLen = k->g.tyDb.len;
+  TyDb_new(&k->g.tyDb); TyDb* db = tyDb(k, false);
 
   DictStk_add(&k->g.dictStk, (TyDict*) fn); // local variables
 
@@ -1577,21 +3742,29 @@ void N_fn(Kern* k) {
 
   // Force a RET at the end, whether UNTY or not.
   if( (not IS_UNTY and not TyDb_done(db))
-      or  (IS_UNTY and (RET != code->dat[code->len-1]))) _N_ret(k);
+      or  (IS_UNTY and not peepLastIs(k, RET))) _N_ret(k);
+  if(k->g.opt) optFn(k, code);
+  if(not isFnInline(fn)) tailCalls(code);
+  relaxJmps(code);
 
   // Free unused area of buffers
   ASSERT(not BBA_free(&k->bbaCode, code->dat + code->len, code->cap - code->len, 1),
          "N_fn free");
 
+#ifdef FNGI_XCACHE
+  xcFree(k, fn); // (re)translated on next execution
+#endif
   fn->code = code->dat; fn->len = code->len;
+#ifdef FNGI_JIT
+  fn->jit = NULL; fn->calls = 0;
+#endif
   fn->lSlots = align(k->g.fnLocals, RSIZE) / RSIZE;
   k->g.fnLocals = 0; k->g.metaNext = 0;
   *code = prevCode;
 
   TyDb_drop(k, db);
-  ASSERT(db_startLen == Stk_len(&k->g.tyDb.done),
+  ASSERT(db_startLen == k->g.tyDb.len,
          "A type operation (i.e. if/while/etc) is incomplete in fn");
-  END_LOCAL_TYDB_BBA(tyDb);
   DictStk_pop(&k->g.dictStk);
   k->g.curTy = prevTy;
 }
@@ -1630,20 +3803,21 @@ void N_meth(Kern* k) {
 
 typedef struct { bool hadFull; bool hadElse; } IfState;
 
-U2 _if(Buf* b) { // flow control only (no type checking)
-  Buf_add(b, SZ2 | JLZ); Buf_addBE2(b, 0);
-  return b->len - 2;
+U2 _if(Kern* k) { // flow control only (no type checking)
+  op2(k, JLZ, SZ2, 0);
+  return k->g.code.len - 2;
 }
 
-void _endIf(Buf* b, U2 i) { // flow control only
+void _endIf(Kern* k, U2 i) { // flow control only
+  Buf* b = &k->g.code;
   srBE2(&b->dat[i], b->len - i);
+  peepReset(k); // jmp target
 }
 
-U2 _else(Buf* b, U2 iIf) { // flow control only
-  Buf_add(b, SZ2 | JL); // end of if has unconditional jmp to end of else
-  Buf_addBE2(b, 0);
-  _endIf(b, iIf); // if jmps into else block
-  return b->len - 2;
+U2 _else(Kern* k, U2 iIf) { // flow control only
+  op2(k, JL, SZ2, 0); // end of if has unconditional jmp to end of else
+  _endIf(k, iIf); // if jmps into else block
+  return k->g.code.len - 2;
 }
 
 #define DBG_TYS(...) \
@@ -1667,23 +3841,22 @@ IfState tyIf(Kern* k, IfState is) {
 
 IfState _N_if(Kern* k, IfState is) {
   TyDb* db = tyDb(k, false);
-  Buf* b = &k->g.code;
-  U2 i = _if(b);
+  U2 i = _if(k);
   REQUIRE("do"); Kern_compFn(k);
   is = tyIf(k, is);
 
   if(CONSUME("elif")) {
-    i = _else(b, i);
+    i = _else(k, i);
     Kern_compFn(k); tyCall(k, db, &TyIs_S, NULL);
     ASSERT(IS_UNTY or not TyDb_done(db), "Detected done in elif test");
     is = _N_if(k, is);
   } else if(CONSUME("else")) {
-    i = _else(b, i);
+    i = _else(k, i);
     Kern_compFn(k); // else body
     is = tyIf(k, is);
     is.hadElse = true;
   }
-  _endIf(b, i);
+  _endIf(k, i);
   return is;
 }
 
@@ -1703,6 +3876,103 @@ void N_if(Kern* k) {
   tyIfEnd(k, _N_if(k, (IfState){0}));
 }
 
+// ***********************
+//   * match
+// Multi-way branch on an S. Case values are evaluated immediately.
+//
+//   match(x) case 1 do a  case 2 do b  case 5 do c  else d
+//
+// The cases are type checked like if/elif/else. Their bodies are compiled
+// first, followed by the dispatch (the subject stays on WS until then): a JTBL
+// when the values are dense, else a binary decision tree of compares.
+
+typedef struct { U4 v; U2 at; } MatchCase;
+
+static U2 matchJmp(Kern* k, U1 op) { op2(k, op, SZ2, 0); return k->g.code.len - 2; }
+static void matchPatch(Kern* k, U2 at, U2 to) { srBE2(k->g.code.dat + at, to - at); }
+
+static U4 matchValue(Kern* k) {
+  single(k, /*asImm*/true); tyCall(k, tyDb(k, true), &TyIs_S, NULL);
+  return WS_POP();
+}
+
+// Compare the subject against sorted c[lo..hi], jmping to the case (after
+// dropping it) or adding a JL to fails.
+static void matchTree(Kern* k, MatchCase* c, U2 lo, U2 hi, U2* fails, U2* failLen) {
+  if(hi - lo < 3) {
+    for(U2 i = lo; i <= hi; i++) {
+      op0(k, DUP); lit(k, c[i].v); U2 ne = matchJmp(k, JNE);
+      op0(k, DRP); matchPatch(k, matchJmp(k, JL), c[i].at);
+      matchPatch(k, ne, k->g.code.len); peepReset(k);
+    }
+    fails[(*failLen)++] = matchJmp(k, JL);
+    return;
+  }
+  U2 mid = (lo + hi + 1) / 2;
+  op0(k, DUP); lit(k, c[mid].v); op0(k, LT_U); U2 right = matchJmp(k, JLZ);
+  matchTree(k, c, lo, mid - 1, fails, failLen);
+  matchPatch(k, right, k->g.code.len); peepReset(k);
+  matchTree(k, c, mid, hi, fails, failLen);
+}
+
+void N_match(Kern* k) {
+  N_notImm(k); TyDb* db = tyDb(k, false); Buf* b = &k->g.code;
+  Kern_compFn(k); tyCall(k, db, &TyIs_S, NULL);
+  ASSERT(IS_UNTY or not TyDb_done(db), "Detected done in match subject");
+  tyClone(k, db, 0);
+  MatchCase c[MATCH_MAX]; U2 n = 0;
+  U2 ends[MATCH_MAX + 1], endLen = 0; // JLs to the end
+  U2 dflts[2 * MATCH_MAX + 1], dfltLen = 0; // JLs (or table entries) to default
+  IfState is = {0};
+  U2 dispatch = matchJmp(k, JL);
+  while(CONSUME("case")) {
+    ASSERT(n < MATCH_MAX, "match: too many cases");
+    U4 v = matchValue(k);
+    for(U2 i = 0; i < n; i++) ASSERT(c[i].v != v, "match: duplicate case");
+    REQUIRE("do"); peepReset(k); // jmp target
+    c[n++] = (MatchCase) { .v = v, .at = b->len };
+    Kern_compFn(k); is = tyIf(k, is);
+    ends[endLen++] = matchJmp(k, JL);
+  }
+  ASSERT(n, "match: expected case");
+  I4 dflt = -1;
+  if(CONSUME("else")) {
+    peepReset(k); dflt = b->len;
+    Kern_compFn(k); is = tyIf(k, is); is.hadElse = true;
+    ends[endLen++] = matchJmp(k, JL);
+  }
+
+  matchPatch(k, dispatch, b->len); peepReset(k);
+  for(U2 i = 1; i < n; i++) { // sort by value
+    MatchCase m = c[i]; U2 j = i;
+    for(; j and (c[j - 1].v > m.v); j--) c[j] = c[j - 1];
+    c[j] = m;
+  }
+  U4 gap = c[n - 1].v - c[0].v; // gap + 1 wraps when the cases span all of U4
+  if((n >= 3) and (gap < 2 * n)) { // dense: JTBL on (subject - min)
+    U4 span = gap + 1;
+    if(c[0].v) { lit(k, c[0].v); op0(k, SUB); }
+    op2(k, JTBL, SZ2, span);
+    for(U2 e = 0, ci = 0; e < span; e++) {
+      U2 at = b->len; Buf_addBE2(b, 0);
+      if(c[ci].v == c[0].v + e) matchPatch(k, at, c[ci++].at);
+      else                      dflts[dfltLen++] = at;
+    }
+    peepReset(k); // table is not code
+    dflts[dfltLen++] = matchJmp(k, JL); // out of bounds
+  } else {
+    U2 fails[MATCH_MAX], failLen = 0;
+    matchTree(k, c, 0, n - 1, fails, &failLen);
+    for(U2 i = 0; i < failLen; i++) matchPatch(k, fails[i], b->len);
+    peepReset(k); op0(k, DRP);
+    dflts[dfltLen++] = matchJmp(k, JL);
+  }
+  for(U2 i = 0; i < dfltLen; i++) matchPatch(k, dflts[i], (dflt >= 0) ? dflt : b->len);
+  for(U2 i = 0; i < endLen; i++) matchPatch(k, ends[i], b->len);
+  peepReset(k); // jmp target
+  tyIfEnd(k, is);
+}
+
 // ***********************
 //   * blk
 //
@@ -1740,9 +4010,7 @@ void tyCont(Kern* k, TyDb* db) {
 void N_cont(Kern* k) {
   N_notImm(k);
   tyCont(k, tyDb(k, false));
-  Buf* b = &k->g.code;
-  Buf_add(b, SZ2 | JL);
-  Buf_addBE2(b, k->g.blk->start - b->len);
+  op2(k, JL, SZ2, k->g.blk->start - (k->g.code.len + 1));
 }
 
 void tyBreak(Kern* k, TyDb* db) {
@@ -1753,7 +4021,7 @@ void tyBreak(Kern* k, TyDb* db) {
     tyCheck(blk->endTyI, TyDb_top(db), /*sameLen*/true,
             SLC("Type error: breaks not identical type."));
   } else {
-    TyI_cloneAdd(k->g.bbaDict, &k->g.blk->endTyI, TyDb_top(db));
+    k->g.blk->endTyI = TyDb_top(db);
   }
   TyDb_setDone(db, /*done*/true);
 }
@@ -1761,12 +4029,10 @@ void tyBreak(Kern* k, TyDb* db) {
 void N_brk(Kern* k) {
   N_notImm(k); Kern_compFn(k);
   tyBreak(k, tyDb(k, false));
-  Buf* b = &k->g.code;
 
-  Buf_add(b, SZ2 | JL); // unconditional jump to end of block
+  op2(k, JL, SZ2, 0); // unconditional jump to end of block
   Sll* br = BBA_alloc(k->g.bbaDict, sizeof(Sll), RSIZE); ASSERT(br, "brk OOM");
-  Sll_add(&k->g.blk->breaks, br);  br->dat = b->len;
-  Buf_addBE2(b, 0);
+  Sll_add(&k->g.blk->breaks, br);  br->dat = k->g.code.len - 2;
 }
 
 void N_blk(Kern* k) {
@@ -1774,8 +4040,8 @@ void N_blk(Kern* k) {
   Buf* b = &k->g.code;
   Blk* blk = BBA_alloc(k->g.bbaDict, sizeof(Blk), RSIZE);
   ASSERT(blk, "block OOM");
-  *blk = (Blk) { .start = b->len };
-  TyI_cloneAdd(k->g.bbaDict, &blk->startTyI, TyDb_top(db));
+  *blk = (Blk) { .start = b->len }; peepReset(k); // cont target
+  blk->startTyI = TyDb_top(db);
   Sll_add(Blk_root(k), Blk_asSll(blk));
 
   Kern_compFn(k); // compile code block
@@ -1783,6 +4049,11 @@ void N_blk(Kern* k) {
   for(Sll* br = blk->breaks; br; br = br->next) {
     srBE2(b->dat + br->dat, b->len - br->dat);
   }
+  if(not IS_UNTY and blk->endTyI) { // code after blk continues from the breaks
+    *TyDb_root(db) = blk->endTyI;
+    TyDb_setDone(db, false);
+  }
+  peepReset(k); // brk target
 }
 
 // ***********************
@@ -1831,9 +4102,8 @@ void N_dot(Kern* k) { // A reference is on the stack, get a (sub)field
   ASSERT(not isDictNative(d), "invalid '.' on native type");
   ASSERT(not isDictMod(d), "accessing mod through ref");
 
-  Buf* b = &k->g.code;
   // Trim the refs to be only 1
-  while(refs > 1) { Buf_add(b, FT | SZR); }
+  while(refs > 1) { op0(k, FT | SZR); }
   TyDb_pop(k, db);
   Ty* ty = TyDict_scanTy(k, d); ASSERT(ty, "member not found");
   if(isTyVar(ty)) {
@@ -1860,12 +4130,12 @@ void ampRef(Kern* k, TyI* tyI) {
       while(refs > 1) {
         opOffset(k, b, FTO, SZR, offset, NULL); offset = 0; refs -= 1;
       }
-      TyVar* var = tyVar(TyDict_find(tyDict(var->tyI->ty), tokenSlc(k)));
+      TyVar* var = tyVar(Kern_findIn(k, tyDict(var->tyI->ty), tokenSlc(k)));
       assert(not isVarGlobal(var));
       tyI = var->tyI; offset += var->v;
     } else {
       ASSERT(TyI_refs(tyI) + 1 <= TY_REFS, "refs too large");
-      if(offset) { lit(b, offset); Buf_add(b, ADD); }
+      if(offset) { lit(k, offset); op0(k, ADD); }
       TyDb_drop(k, db);
       TyI out = (TyI) { .ty = tyI->ty, .meta = tyI->meta + 1 };
       return tyCall(k, db, NULL, &out);
@@ -1901,20 +4171,19 @@ void N_amp(Kern* k) {
   assert(not isVarGlobal(var)); // TODO
   U2 offset = var->v; TyI* tyI = var->tyI;
   while(not TyI_refs(tyI) and CONSUME(".")) {
-    var = (TyVar*) TyDict_find(tyDict(var->tyI->ty), tokenSlc(k));
+    var = (TyVar*) Kern_findIn(k, tyDict(var->tyI->ty), tokenSlc(k));
     assert(isTyVar((Ty*)var)); // TODO: support function
     offset += var->v; tyI = var->tyI;
   }
-  Buf* b = &k->g.code;
   if(PEEK(".")) {
     assert(TyI_refs(tyI));
-    op2(b, FTLL, SZR, offset);
+    op2(k, FTLL, SZR, offset);
     return ampRef(k, tyI);
   }
   ASSERT(TyI_refs(tyI) + 1 <= TY_REFS, "refs too large");
   TyI out = (TyI) { .ty = tyI->ty, .meta = tyI->meta + 1 };
   tyCall(k, tyDb(k, false), NULL, &out);
-  op2(b, LR, 0, offset);
+  op2(k, LR, 0, offset);
 }
 
 void N_at(Kern* k) {
@@ -1926,12 +4195,12 @@ void N_at(Kern* k) {
   }
   TyI* top = TyDb_top(db); U2 refs = TyI_refs(top);
   ASSERT(refs, "invalid '@', the value on the stack is not a reference");
-  if(refs > 1) Buf_add(&k->g.code, FT | SZR);
+  if(refs > 1) op0(k, FT | SZR);
   else if (not isTyDict(top->ty)) { SET_ERR(SLC("Cannot fetch non-dict type")); }
   else {
     TyDict* d = (TyDict*) top->ty;
     ASSERT(not isDictMod(d), "Cannot @mod");
-    if(isDictNative(d)) Buf_add(&k->g.code, FT | (SZ_MASK & (S)d->children));
+    if(isDictNative(d)) op0(k, FT | (SZ_MASK & (S)d->children));
     else assert(false);
   }
 
@@ -1966,7 +4235,7 @@ void N_ptrAdd(Kern* k) {
               inp[2] = (TyI) {.ty = (Ty*)&Ty_S, .next = &inp[1]};
   tyCall(k, db, &inp[2], &inp[0]);
   TyI derefTyI = {.ty = ptrTy->ty, .meta = ptrTy->meta - 1};
-  lit(&k->g.code, TyI_sz(&derefTyI));
+  lit(k, TyI_sz(&derefTyI));
   Kern_typed(k, false);
   compileFn(k, &TyFn_ptrAddRaw, asImm);
   Kern_typed(k, true);
@@ -1994,172 +4263,124 @@ void N_findTy(Kern* k) {
   WS_POP2(S dat, S len);
   WS_ADD((S)Kern_findTy(k, (Slc){.dat = (U1*)dat, .len = len}));
 }
+void N_setOpt(Kern* k) { k->g.opt = WS_POP(); } // level ->
 
-// ***********************
-// * 7: Registering Functions
+void N_spawnFn(Kern* k) { // fn -> fiber
+  WS_ADD(Kern_fiberHandle(k, Kern_spawn(k, (TyFn*)WS_POP())));
+}
+TyFn TyFn_spawnFn = TyFn_native("\x07" "spawnFn", 0, (U1*)N_spawnFn, &TyIs_S, &TyIs_S);
 
-#define ADD_ANY_VAR(VAR, TY, NAMELEN, NAME, META, VNAME, V) \
-  CStr_ntVar(LINED(key), NAMELEN, NAME);\
-  VAR = (TY) {          \
-    .bst.key = LINED(key),              \
-    .meta =  META,                      \
-    .VNAME = V,                         \
-  };                                    \
-  Kern_addTy(k, (Ty*)&VAR);
-
-#define ADD_ANY_CREATE(TY, NAMELEN, NAME, META, VNAME, V) \
-  static TY LINED(ty);                  \
-  ADD_ANY_VAR(LINED(ty), TY, NAMELEN, NAME, META, VNAME, V)
-
-#define ADD_TY_NATIVE(VAR, NAMELEN, NAME, META, VAL) \
-  ADD_ANY_VAR(VAR, TyDict, NAMELEN, NAME, TY_DICT | TY_DICT_NATIVE | META, children, VAL)
-
-#define ADD_FN(NAMELEN, NAME, META, CODE, INP, OUT) \
-  ADD_ANY_CREATE(TyFn, NAMELEN, NAME, TY_FN | TY_FN_NATIVE | (META), code, (U1*)CODE); \
-  LINED(ty).inp = INP; LINED(ty).out = OUT;
-
-#define ADD_INLINE_FN(NAMELEN, NAME, META, INP, OUT, ...)     \
-  assert(sizeof((U1[]){__VA_ARGS__}) < 0xFF);                 \
-  static U1 LINED(code)[] = {__VA_ARGS__ __VA_OPT__(,) RET};  \
-  ADD_FN(NAMELEN, NAME, TY_FN_INLINE | (META), (S)LINED(code), INP, OUT); \
-  LINED(ty).len = sizeof(LINED(code)) - 1;
-
-void Kern_fns(Kern* k) {
-  // Native data types
-  ADD_TY_NATIVE(Ty_UNSET, "\x08", "Ty_UNSET",  0      , (Ty*)(SZR + 1));
-  ADD_TY_NATIVE(Ty_Any,   "\x03", "Any"     ,  0      , (Ty*)(SZR + 1));
-  ADD_TY_NATIVE(Ty_Unsafe,"\x06", "Unsafe"  ,  0      , (Ty*)(SZR + 1));
-
-  TyIs_UNSET  = (TyI) { .ty = (Ty*)&Ty_UNSET  };
-  TyIs_Unsafe = (TyI) { .ty = (Ty*)&Ty_Unsafe };
-  TyIs_rAny   = (TyI) { .ty = (Ty*)&Ty_Any, .meta = 1 };
-  TyIs_rAnyS  = (TyI) { .ty = (Ty*)&Ty_S, .next = &TyIs_rAny };
-  TyIs_rAnySS = (TyI) { .ty = (Ty*)&Ty_S, .next = &TyIs_rAnyS };
-
-  ADD_TY_NATIVE(Ty_U1, "\x02", "U1",  0               , (Ty*)SZ1);
-  ADD_TY_NATIVE(Ty_U2, "\x02", "U2",  0               , (Ty*)SZ2);
-  ADD_TY_NATIVE(Ty_U4, "\x02", "U4",  0               , (Ty*)SZ4);
-  ADD_TY_NATIVE(Ty_S , "\x01", "S",   0               , (Ty*)SZR);
-  ADD_TY_NATIVE(Ty_I1, "\x02", "I1",  TY_NATIVE_SIGNED, (Ty*)SZ1);
-  ADD_TY_NATIVE(Ty_I2, "\x02", "I2",  TY_NATIVE_SIGNED, (Ty*)SZ2);
-  ADD_TY_NATIVE(Ty_I4, "\x02", "I4",  TY_NATIVE_SIGNED, (Ty*)SZ4);
-  ADD_TY_NATIVE(Ty_SI, "\x02", "SI",  TY_NATIVE_SIGNED, (Ty*)SZR);
-  TASSERT_EMPTY();
-
-  // Ty: S
-  TyIs_S = (TyI) { .ty = (Ty*)&Ty_S };
-  // Ty: S, s
-  TyIs_SS = (TyI) { .next = &TyIs_S, .ty = (Ty*)&Ty_S };
-  // Ty: S, s, S
-  TyIs_SSS = (TyI) { .next = &TyIs_SS, .ty = (Ty*)&Ty_S };
-
-  TyIs_U1 = (TyI) { .ty = (Ty*)&Ty_U1 };
-  TyIs_U2 = (TyI) { .ty = (Ty*)&Ty_U2 };
-  TyIs_U4 = (TyI) { .ty = (Ty*)&Ty_U4 };
-  TyIs_U4x2 = (TyI) { .next = &TyIs_U4, .ty = (Ty*)&Ty_U4 };
-
-  TyIs_rU1 = (TyI) { .ty = (Ty*)&Ty_U1, .meta = 1 };
-  TyIs_rU2 = (TyI) { .ty = (Ty*)&Ty_U2, .meta = 1 };
-  TyIs_rU4 = (TyI) { .ty = (Ty*)&Ty_U4, .meta = 1 };
-
-  TyIs_rU1_U4 = (TyI) {.ty = (Ty*)&Ty_U4, .next = &TyIs_rU4};
-
-  Kern_addTy(k, (Ty*) &TyFn_baseCompFn);
-  Kern_addTy(k, (Ty*) &TyFn_stk);
-  Kern_addTy(k, (Ty*) &TyFn_inp);
-  Kern_addTy(k, (Ty*) &TyFn_memclr);
-
-  ADD_FN("\x01", "\\"           , TY_FN_COMMENT   , N_fslash   , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", "_"            , TY_FN_SYN       , N_noop     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", ";"            , TY_FN_SYN       , N_noop     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", ","            , TY_FN_SYN       , N_noop     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x02", "->"           , TY_FN_SYN       , N_noop     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x06", "notImm"       , TY_FN_SYN       , N_notImm   , TYI_VOID, TYI_VOID);
-  ADD_FN("\x04", "unty"         , TY_FN_SYN       , N_unty     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "ret"          , TY_FN_SYN       , N_ret      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "imm"          , TY_FN_SYN       , N_imm      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", "("            , TY_FN_SYN       , N_paren    , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "mod"          , TY_FN_SYN       , N_mod      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "loc"          , TY_FN_SYN       , N_loc      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x07", "fileloc"      , TY_FN_SYN       , N_fileloc  , TYI_VOID, TYI_VOID);
-  ADD_FN("\x02", "fn"           , TY_FN_SYN       , N_fn       , TYI_VOID, TYI_VOID);
-  ADD_FN("\x04", "meth"         , TY_FN_SYN       , N_meth     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x04", "fnTy"         , TY_FN_SYN       , N_fnTy     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "var"          , TY_FN_SYN       , N_var      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x02", "if"           , TY_FN_SYN       , N_if       , TYI_VOID, TYI_VOID);
-  ADD_FN("\x04", "cont"         , TY_FN_SYN       , N_cont     , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "brk"          , TY_FN_SYN       , N_brk      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x03", "blk"          , TY_FN_SYN       , N_blk      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x06", "struct"       , TY_FN_SYN       , N_struct   , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", "."            , TY_FN_SYN       , N_dot      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", "&"            , TY_FN_SYN       , N_amp      , TYI_VOID, TYI_VOID);
-  ADD_FN("\x01", "@"            , TY_FN_SYN       , N_at       , TYI_VOID, TYI_VOID);
-  ADD_FN("\x06", "ptrAdd"       , TY_FN_SYN       , N_ptrAdd   , TYI_VOID, TYI_VOID);
-  ADD_FN("\x08", "destruct"     , TY_FN_SYN       , N_destruct , TYI_VOID, TYI_VOID);
-  ADD_FN("\x05", "dbgRs"        , 0               , N_dbgRs    , TYI_VOID, TYI_VOID);
-  ADD_FN("\x09", "tAssertEq"    , 0               , N_tAssertEq, &TyIs_SS, TYI_VOID);
-  ADD_FN("\x0D", "assertWsEmpty", 0               , N_assertWsEmpty, TYI_VOID, TYI_VOID);
-  // FIXME: getting weird error
-  ADD_FN("\x07", "setFnTy"      , TY_FN_SYN       , N_setFnTy  , TYI_VOID, TYI_VOID);
-
-  // Stack operators. These are **not** PRE since they directly modify the stack.
-  ADD_INLINE_FN("\x03", "swp"  , 0       , &TyIs_SS, &TyIs_SS,   SWP   );
-  ADD_INLINE_FN("\x03", "drp"  , 0       , &TyIs_S,  TYI_VOID,   DRP   );
-  ADD_INLINE_FN("\x03", "ovr"  , 0       , &TyIs_SS, &TyIs_SSS,  OVR   );
-  ADD_INLINE_FN("\x03", "dup"  , 0       , &TyIs_S,  &TyIs_SS,   DUP   );
-  ADD_INLINE_FN("\x04", "dupn" , 0       , &TyIs_S,  &TyIs_SS,   DUPN  );
-
-  // Standard operators that use PRE syntax. Either "a <op> b" or simply "<op> b"
-  ADD_INLINE_FN("\x03", "nop"  , 0       , &TyIs_S,  &TyIs_S, NOP     );
-  ADD_INLINE_FN("\x03", "inc"  , 0       , &TyIs_S,  &TyIs_S, INC     );
-  ADD_INLINE_FN("\x04", "inc2" , 0       , &TyIs_S,  &TyIs_S, INC2    );
-  ADD_INLINE_FN("\x04", "inc4" , 0       , &TyIs_S,  &TyIs_S, INC4    );
-  ADD_INLINE_FN("\x03", "dec"  , 0       , &TyIs_S,  &TyIs_S, DEC     );
-  ADD_INLINE_FN("\x03", "inv"  , 0       , &TyIs_S,  &TyIs_S, INV     );
-  ADD_INLINE_FN("\x03", "neg"  , 0       , &TyIs_S,  &TyIs_S, NEG     );
-  ADD_INLINE_FN("\x03", "not"  , 0       , &TyIs_S,  &TyIs_S, NOT     );
-  ADD_INLINE_FN("\x05", "i1to4", 0       , &TyIs_S,  &TyIs_S, CI1     );
-  ADD_INLINE_FN("\x05", "i2to4", 0       , &TyIs_S,  &TyIs_S, CI2     );
-  ADD_INLINE_FN("\x01", "+"    , 0       , &TyIs_SS, &TyIs_S, ADD     );
-  ADD_INLINE_FN("\x01", "-"    , 0       , &TyIs_SS, &TyIs_S, SUB     );
-  ADD_INLINE_FN("\x01", "%"    , 0       , &TyIs_SS, &TyIs_S, MOD     );
-  ADD_INLINE_FN("\x03", "shl"  , 0       , &TyIs_SS, &TyIs_S, SHL     );
-  ADD_INLINE_FN("\x03", "shr"  , 0       , &TyIs_SS, &TyIs_S, SHR     );
-  ADD_INLINE_FN("\x03", "msk"  , 0       , &TyIs_SS, &TyIs_S, MSK     );
-  ADD_INLINE_FN("\x02", "jn"   , 0       , &TyIs_SS, &TyIs_S, JN      );
-  ADD_INLINE_FN("\x03", "xor"  , 0       , &TyIs_SS, &TyIs_S, XOR     );
-  ADD_INLINE_FN("\x03", "and"  , 0       , &TyIs_SS, &TyIs_S, AND     );
-  ADD_INLINE_FN("\x02", "or"   , 0       , &TyIs_SS, &TyIs_S, OR      );
-  ADD_INLINE_FN("\x02", "=="   , 0       , &TyIs_SS, &TyIs_S, EQ      );
-  ADD_INLINE_FN("\x02", "!="   , 0       , &TyIs_SS, &TyIs_S, NEQ     );
-  ADD_INLINE_FN("\x02", ">="   , 0       , &TyIs_SS, &TyIs_S, GE_U    );
-  ADD_INLINE_FN("\x01", "<"    , 0       , &TyIs_SS, &TyIs_S, LT_U    );
-  ADD_INLINE_FN("\x04", "ge_s" , 0       , &TyIs_SS, &TyIs_S, GE_S    );
-  ADD_INLINE_FN("\x04", "lt_s" , 0       , &TyIs_SS, &TyIs_S, LT_S    );
-  ADD_INLINE_FN("\x01", "*"    , 0       , &TyIs_SS, &TyIs_S, MUL     );
-  ADD_INLINE_FN("\x01", "/"    , 0       , &TyIs_SS, &TyIs_S, DIV_U   );
-
-  ADD_INLINE_FN("\x03", "ft1"  , 0       , &TyIs_S, &TyIs_S , SZ1+FT  );
-  ADD_INLINE_FN("\x03", "ft2"  , 0       , &TyIs_S, &TyIs_S , SZ2+FT  );
-  ADD_INLINE_FN("\x03", "ft4"  , 0       , &TyIs_S, &TyIs_S , SZ4+FT  );
-  ADD_INLINE_FN("\x03", "ftR"  , 0       , &TyIs_S, &TyIs_S , SZR+FT  );
-  ADD_INLINE_FN("\x05", "ftBe1", 0       , &TyIs_S, &TyIs_S , SZ1+FTBE);
-  ADD_INLINE_FN("\x05", "ftBe2", 0       , &TyIs_S, &TyIs_S , SZ2+FTBE);
-  ADD_INLINE_FN("\x05", "ftBe4", 0       , &TyIs_S, &TyIs_S , SZ4+FTBE);
-  ADD_INLINE_FN("\x05", "ftBeR", 0       , &TyIs_S, &TyIs_S , SZR+FTBE);
-
-  static TyDict comp; // these are all inside comp
-  ADD_ANY_VAR(comp, TyDict, "\x04", "comp", TY_DICT | TY_DICT_MOD, children, /*v=*/0);
-  DictStk_add(&k->g.dictStk, &comp);
-  ADD_FN("\x06", "single"     , 0   , N_single     , &TyIs_S, TYI_VOID);
-  ADD_FN("\x0A", "compileLit" , 0   , N_compileLit , &TyIs_SS, TYI_VOID);
-  ADD_FN("\x09", "compileTy"  , 0   , N_compileTy  , &TyIs_UNSET, &TyIs_UNSET);
-  ADD_FN("\x06", "findTy"     , 0   , N_findTy     , &TyIs_UNSET, &TyIs_UNSET);
-  DictStk_pop(&k->g.dictStk);
-  // assert(&comp.v == (S)DictStk_pop(&k->g.dictStk).root);
+// spawn <fn> -> fiber: call fn (no inputs) in a new fiber, see yield
+void N_spawn(Kern* k) {
+  N_notImm(k);
+  scan(k); Ty* ty = Kern_findToken(k);
+  ASSERT(ty and isTyFn(ty) and not isFnNative((TyFn*)ty), "spawn: expected fngi fn");
+  ASSERT(not ((TyFn*)ty)->inp, "spawn: fn must have no inputs"); tokenDrop(k);
+  lit(k, (S)ty); opCall(k, &TyFn_spawnFn);
+  tyCall(k, tyDb(k, false), NULL, &TyIs_S);
+}
+
+// Compile a YLD which is skipped unless the native just called returned true
+// (it blocked cfb).
+static void compileBlockYld(Kern* k) {
+  U2 i = _if(k); op0(k, YLD); _endIf(k, i);
+}
+
+void N_fiberJoin(Kern* k) { // fiber -> blocked
+  FnFiber* fb = Kern_fiber(k, WS_POP()); // NULL: done, and reused since
+  ASSERT(fb != cfb, "join: fiber cannot join itself");
+  if(not fb or (FIBER_DONE == fb->state)) return WS_ADD(false);
+  ASSERT(1 == k->loopDepth, "join: not in the outermost executeLoop");
+  cfb->state = FIBER_BLOCKED;
+  cfb->next = fb->joiners; fb->joiners = cfb;
+  WS_ADD(true);
+}
+TyFn TyFn_fiberJoin = TyFn_native("\x09" "fiberJoin", 0, (U1*)N_fiberJoin, &TyIs_S, &TyIs_S);
+
+// join <fiber>: blocks (yields) until the fiber is done
+void N_join(Kern* k) {
+  N_notImm(k); Kern_compFn(k);
+  opCall(k, &TyFn_fiberJoin); compileBlockYld(k);
+  tyCall(k, tyDb(k, false), &TyIs_S, NULL);
+}
+
+void N_fiber(Kern* k) { WS_ADD(Kern_fiberHandle(k, cfb)); } // -> the current fiber
+
+#ifdef FNGI_FUEL
+static FnFiber* fiberArg(Kern* k, S h) {
+  FnFiber* fb = Kern_fiber(k, h); ASSERT(fb, "fiber was reused");
+  return fb;
+}
+void N_setFuel(Kern* k) { // fiber fuel slice ->
+  WS_POP3(S fb, U4 fuel, U4 slice); FnFiber_setFuel(fiberArg(k, fb), fuel, slice);
+}
+void N_fuel(Kern* k)     { WS_ADD(FnFiber_fuel(fiberArg(k, WS_POP()))); }     // fiber -> fuel
+void N_fuelUsed(Kern* k) { WS_ADD(FnFiber_fuelUsed(fiberArg(k, WS_POP()))); } // fiber -> used
+#endif
+
+void N_chan(Kern* k)     { WS_ADD((S)Kern_chan(k, WS_POP(), true)); }  // cap -> chan
+void N_chanSpsc(Kern* k) { WS_ADD((S)Kern_chan(k, WS_POP(), false)); } // cap -> chan
+void N_chanFree(Kern* k) { Kern_chanFree(k, (Chan*)WS_POP()); }         // chan ->
+
+void N_chanSend(Kern* k) { // chan v -> blocked
+  WS_POP2(S ch, S v);
+  if(Chan_trySend(k, (Chan*)ch, v)) return WS_ADD(false);
+  cfb->msg = v; chanBlock(k, (Chan*)ch, true);
+  WS_ADD(true);
+}
+void N_chanRecv(Kern* k) { // chan -> blocked, the value is in cfb->msg
+  Chan* ch = (Chan*) WS_POP();
+  if(Chan_tryRecv(k, ch, &cfb->msg)) return WS_ADD(false);
+  chanBlock(k, ch, false);
+  WS_ADD(true);
+}
+void N_chanMsg(Kern* k) { WS_ADD(cfb->msg); } // -> v
+TyFn TyFn_chanSend = TyFn_native("\x08" "chanSend", 0, (U1*)N_chanSend, &TyIs_ChanS, &TyIs_S);
+TyFn TyFn_chanRecv = TyFn_native("\x08" "chanRecv", 0, (U1*)N_chanRecv, &TyIs_Chan, &TyIs_S);
+TyFn TyFn_chanMsg  = TyFn_native("\x07" "chanMsg",  0, (U1*)N_chanMsg,  TYI_VOID, &TyIs_S);
+
+// send(chan, v): blocks (yields) while the chan is full
+void N_send(Kern* k) {
+  N_notImm(k); Kern_compFn(k);
+  opCall(k, &TyFn_chanSend); compileBlockYld(k);
+  tyCall(k, tyDb(k, false), &TyIs_ChanS, NULL);
+}
+
+// recv <chan> -> v: blocks (yields) while the chan is empty
+void N_recv(Kern* k) {
+  N_notImm(k); Kern_compFn(k);
+  opCall(k, &TyFn_chanRecv); compileBlockYld(k); opCall(k, &TyFn_chanMsg);
+  tyCall(k, tyDb(k, false), &TyIs_Chan, &TyIs_S);
+}
 
-  TASSERT_EMPTY();
+#ifdef FNGI_STATS
+void N_fnStatsOf(Kern* k) { // fn -> calls incl excl maxRs
+  FnStats* s = fnStats((TyFn*) WS_POP()); FnStats z = {0};
+  if(not s) s = &z;
+  WS_ADD(s->calls);
+  WS_ADD((s->incl > 0xFFFFFFFF) ? 0xFFFFFFFF : s->incl);
+  WS_ADD((s->excl > 0xFFFFFFFF) ? 0xFFFFFFFF : s->excl);
+  WS_ADD(s->maxRs);
 }
+TyI TyIs_fnStats = (TyI) { .next = &TyIs_SSS, .ty = (Ty*)&Ty_S };
+TyFn TyFn_fnStatsOf = TyFn_native("\x0A" "fnStatsOf", 0, (U1*)N_fnStatsOf, &TyIs_S, &TyIs_fnStats);
+
+// fnStats <fn> -> calls incl excl maxRs (cycles saturate at U4 max)
+void N_fnStats(Kern* k) {
+  N_notImm(k);
+  scan(k); Ty* ty = Kern_findToken(k);
+  ASSERT(ty and isTyFn(ty), "fnStats: expected fn"); tokenDrop(k);
+  lit(k, (S)ty); opCall(k, &TyFn_fnStatsOf);
+  tyCall(k, tyDb(k, false), NULL, &TyIs_fnStats);
+}
+#endif
+
+// ***********************
+// * 7: Registering Functions
+
+// The builtin dictionary is generated by etc/gen.py as constant initialized
+// Tys, so DictStk_reset only has to put Ty_builtins under rootDict.
+#include "builtins.inc"
 
 // ***********************
 // * 8: Execution helpers
@@ -2181,19 +4402,20 @@ void fngiHandleSig(int sig, struct sigcontext ctx) {
 void fngiErrPrinter() { Kern_handleSig(fngiK, 0, NULL); }
 
 void executeInstrs(Kern* k, U1* instrs) {
+#ifdef FNGI_XCACHE
+  instrs = (U1*) xcTranslate(k, &k->bbaRepl, instrs, 0);
+#endif
   cfb->ep = instrs;
   executeLoop(k);
 }
 
 CStr_ntLitUnchecked(replPath, "\x08", "/repl.fn");
-FileInfo replInfo = {0};
-
 U1* compileRepl(Kern* k, bool withRet) {
-  replInfo.path = replPath;
-  k->g.srcInfo = &replInfo;
+  k->g.replInfo.path = replPath;
+  k->g.srcInfo = &k->g.replInfo;
   U1* body = (U1*) BBA_alloc(&k->bbaRepl, 256, 1);
   ASSERT(body, "compileRepl OOM");
-  Buf* code = &k->g.code; *code = (Buf){.dat=body, .cap=256};
+  Buf* code = &k->g.code; *code = (Buf){.dat=body, .cap=256}; peepReset(k);
   compileSrc(k);
   if(withRet) Buf_add(code, RET);
   if(code->len < code->cap) {
@@ -2223,11 +4445,11 @@ void compilePath(Kern* k, CStr* path) {
 
 void simpleRepl(Kern* k) {
   REPL_START;  TyDb* db = tyDb(k, false);
-  size_t cap;  jmp_buf local_errJmp;  jmp_buf* prev_errJmp = civ.fb->errJmp;
+  size_t cap;  jmp_buf local_errJmp;  jmp_buf* prev_errJmp = FNGI_ERRJMP;
   Ring_var(_r, 256);  BufFile f = BufFile_init(_r, (Buf){0});
   k->g.src = (SpReader) {.m = &mSpReader_BufFile, .d = &f };
 
-  civ.fb->errJmp = &local_errJmp;
+  FNGI_ERRJMP = &local_errJmp;
   eprintf(  "Simple REPL: type EXIT to exit\n");
   U2 rsSp = RS->sp; U2 infoSp = cfb->info.sp;
   while(true) {
@@ -2246,6 +4468,249 @@ void simpleRepl(Kern* k) {
     eprintf("> "); dbgWs(k);
     eprintf(" :"); TyI_printAll(TyDb_top(db)); NL;
   }
-  civ.fb->errJmp = prev_errJmp;
+  FNGI_ERRJMP = prev_errJmp;
   REPL_END
 }
+
+#ifdef FNGI_PROF
+#include <signal.h>
+#include <sys/time.h>
+
+//   *******
+//   * 8.a: Sampling profiler
+// The SIGPROF handler copies cfb->ep and the info stack (as N_dbgRs walks it)
+// into the next slot of a preallocated buffer. It is the only writer while the
+// timer is armed so it needs no locks. Samples are only resolved (to names and
+// offsets) by Kern_profStop, after the timer is disarmed.
+
+typedef struct {
+  U2 len, count;
+  TyFn* fn[PROF_DEPTH]; U1* ep[PROF_DEPTH]; // innermost frame first
+} ProfSample;
+
+static ProfSample profBuf[PROF_SAMPLES];
+static volatile sig_atomic_t profLen = 0, profDropped = 0;
+static Kern* volatile profK = NULL;
+
+static void profSig(int sig) {
+  Kern* k = profK;
+  if(not k) return;
+#ifdef FNGI_MT
+  if(k != fngiK) return; // the signal hit another thread
+#endif
+  if(profLen >= PROF_SAMPLES) { profDropped += 1; return; }
+  ProfSample* s = &profBuf[profLen];
+  Stk* info = &cfb->info; Stk* rs = RS;
+  U2 r = rs->sp, n = 0; U1* ep = cfb->ep;
+  for(U2 i = info->sp; (i < info->cap) and (n < PROF_DEPTH); i++) {
+    TyFn* fn = (TyFn*) info->dat[i];
+    s->fn[n] = fn; s->ep[n] = ep; n += 1;
+    r += (fn == &catchTy) ? 0 : fn->lSlots;
+    if(r >= rs->cap) break; // torn (i.e. mid fnEnter)
+    ep = (U1*) rs->dat[r];
+    r += 1;
+  }
+  s->len = n; s->count = 1;
+  profLen += 1;
+}
+
+void Kern_profStart(Kern* k, U4 usec) {
+  ASSERT(not profK, "profiler already running");
+  profLen = 0; profDropped = 0; profK = k;
+  struct sigaction sa = {0};
+  sa.sa_handler = profSig; sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  ASSERT(0 == sigaction(SIGPROF, &sa, NULL), "prof: sigaction");
+  struct itimerval t = {0};
+  t.it_interval.tv_sec = usec / 1000000; t.it_interval.tv_usec = usec % 1000000;
+  t.it_value = t.it_interval;
+  ASSERT(0 == setitimer(ITIMER_PROF, &t, NULL), "prof: setitimer");
+}
+
+// The byte offset of ep in fn, or -1 if it isn't in fn (i.e. the ep of a JIT
+// frame is the caller's).
+static I4 profOffset(TyFn* fn, U1* ep) {
+  if((fn == &catchTy) or isFnNative(fn)) return -1;
+#ifdef FNGI_XCACHE
+  if(fn->xc) return ((XCell*)ep < fn->xc) ? -1 : fnEpOffset(fn, ep);
+#endif
+  if((ep < fn->code) or (ep > fn->code + fn->len)) return -1;
+  return ep - fn->code;
+}
+
+static void profWrite(FILE* f, ProfSample* s) {
+  if(not s->len) fprintf(f, "(none)");
+  for(U2 i = s->len; i--; ) {
+    TyFn* fn = s->fn[i]; I4 off = profOffset(fn, s->ep[i]);
+    fprintf(f, "%.*s", Ty_fmt(fn));
+    if(off >= 0) fprintf(f, "+%u", off);
+    if(i) fprintf(f, ";");
+  }
+  fprintf(f, " %u\n", s->count);
+}
+
+U4 Kern_profStop(Kern* k, FILE* f) {
+  ASSERT(profK == k, "profiler not running");
+  struct itimerval t = {0};
+  setitimer(ITIMER_PROF, &t, NULL);
+  profK = NULL;
+  U4 len = profLen;
+  if(profDropped) eprintf("!! prof: dropped %u samples\n", profDropped);
+  if(not f) return len;
+  for(U4 i = 0; i < len; i++) { // merge identical stacks
+    ProfSample* s = &profBuf[i];
+    if(not s->count) continue;
+    for(U4 j = i + 1; j < len; j++) {
+      ProfSample* o = &profBuf[j];
+      if(not o->count or (o->len != s->len)) continue;
+      if(memcmp(o->fn, s->fn, s->len * sizeof(TyFn*))) continue;
+      if(memcmp(o->ep, s->ep, s->len * sizeof(U1*)))   continue;
+      s->count += o->count; o->count = 0;
+    }
+    profWrite(f, s);
+  }
+  return len;
+}
+#endif // FNGI_PROF
+
+#ifdef FNGI_STATS
+//   *******
+//   * 8.b: Fn stats
+// fnEnter and ret keep a frame per info stack entry of each fiber (so the
+// frames dropped by a panic are simply overwritten) with the fn's stats and its
+// start time. The time of callees is subtracted from the caller's excl, and
+// incl is only added by the outermost call of a recursive fn. Times are on a
+// clock per fiber, which stops while it is switched out.
+
+static FNGI_TLS FnStats fnStatsTbl[FN_STATS];
+typedef struct { FnStats* s; U8 start, child; bool outer; } StatsFrame;
+
+static inline U8 tsc() { return __builtin_ia32_rdtsc(); }
+static inline U8 fbTsc(Kern* k) { return tsc() - cfb->away; }
+
+// The frames of cfb, allocated at its first call (a pooled fiber keeps them).
+static StatsFrame* statsFrames(Kern* k) {
+  if(not cfb->stats) {
+    cfb->stats = BBA_alloc(k->g.bbaDict, cfb->info.cap * sizeof(StatsFrame), 4);
+    ASSERT(cfb->stats, "stats OOM");
+  }
+  return cfb->stats;
+}
+
+void statsSwitch(Kern* k, FnFiber* to) {
+  U8 now = tsc();
+  if(cfb) cfb->awayAt = now;
+  if(to and (to != cfb)) to->away += now - to->awayAt;
+}
+
+static FnStats* fnStatsGet(TyFn* fn, bool add) {
+  U2 i = ((S)fn >> 2) % FN_STATS;
+  for(U2 n = 0; n < FN_STATS; n++, i = (i + 1) % FN_STATS) {
+    FnStats* s = &fnStatsTbl[i];
+    if(s->fn == fn) return s;
+    if(not s->fn) {
+      if(not add) return NULL;
+      s->fn = fn; return s;
+    }
+  }
+  return NULL; // full, fn isn't counted
+}
+
+FnStats* fnStats(TyFn* fn) { return fnStatsGet(fn, false); }
+void fnStatsClear() { memset(fnStatsTbl, 0, sizeof(fnStatsTbl)); }
+
+void statsEnter(Kern* k, TyFn* fn) {
+  StatsFrame* f = statsFrames(k); Stk* info = &cfb->info; U2 i = info->sp;
+  FnStats* s = fnStatsGet(fn, true);
+  f[i].s = s; f[i].child = 0;
+  if(s) {
+    f[i].outer = true;
+    if(s->active) { // recursive, in another fiber or dropped by a panic
+      for(U2 c = i + 1; c < info->cap; c++) {
+        if(((TyFn*)info->dat[c] != &catchTy) and (f[c].s == s)) f[i].outer = false;
+      }
+    }
+    s->calls += 1; s->active += 1;
+    if(Stk_len(RS) > s->maxRs) s->maxRs = Stk_len(RS);
+  }
+  f[i].start = fbTsc(k);
+}
+
+void statsRet(Kern* k) {
+  U8 now = fbTsc(k);
+  StatsFrame* f = statsFrames(k); Stk* info = &cfb->info; U2 i = info->sp;
+  if((TyFn*)info->dat[i] == &catchTy) return;
+  U8 t = now - f[i].start; FnStats* s = f[i].s;
+  if(s) {
+    s->excl += t - f[i].child;
+    if(s->active) s->active -= 1;
+    if(f[i].outer) s->incl += t;
+  }
+  for(U2 c = i + 1; c < info->cap; c++) { // the caller (skipping catch markers)
+    if((TyFn*)info->dat[c] != &catchTy) { f[c].child += t; break; }
+  }
+}
+
+void fnStatsDump(FILE* f) {
+  FnStats* sorted[FN_STATS]; U2 len = 0;
+  for(U2 i = 0; i < FN_STATS; i++) {
+    FnStats* s = &fnStatsTbl[i];
+    if(not s->fn) continue;
+    U2 j = len++; // insertion sort by excl, largest first
+    for(; j and (sorted[j - 1]->excl < s->excl); j--) sorted[j] = sorted[j - 1];
+    sorted[j] = s;
+  }
+  fprintf(f, "%10s %14s %14s %6s  fn\n", "calls", "incl", "excl", "maxRs");
+  for(U2 i = 0; i < len; i++) {
+    FnStats* s = sorted[i];
+    fprintf(f, "%10u %14llu %14llu %6u  %.*s\n",
+            s->calls, s->incl, s->excl, s->maxRs, Ty_fmt(s->fn));
+  }
+}
+#endif // FNGI_STATS
+
+#ifdef FNGI_HIST
+//   *******
+//   * 8.c: Instr histograms
+// histOps and histPairs are counted by executeInstr (so not for JIT'd code).
+
+void histClear() {
+  memset(histOps, 0, sizeof(histOps)); memset(histPairs, 0, sizeof(histPairs));
+}
+
+static void histName(FILE* f, U1 instr) {
+  Slc name = (instr == SLIT) ? Slc_ntLit("SLIT") : instrName(instr);
+  fprintf(f, "%.*s", Dat_fmt(name));
+}
+
+void histDump(FILE* f, U2 top) {
+  U1 ops[0x100]; U2 len = 0; // sorted by count, largest first
+  for(U2 i = 0; i < 0x100; i++) {
+    if(not histOps[i]) continue;
+    U2 j = len++;
+    for(; j and (histOps[ops[j - 1]] < histOps[i]); j--) ops[j] = ops[j - 1];
+    ops[j] = i;
+  }
+  fprintf(f, "# instrs\n");
+  for(U2 i = 0; i < len; i++) {
+    fprintf(f, "%14llu  ", histOps[ops[i]]); histName(f, ops[i]); fprintf(f, "\n");
+  }
+  if(not top) return;
+  U2 pairs[top]; len = 0; // the top pairs as (first << 8 | second)
+  for(U4 p = 0; p < 0x10000; p++) {
+    U8 c = histPairs[p >> 8][0xFF & p];
+    if(not c) continue;
+    U2 j = (len < top) ? len++ : top;
+    for(; j and (histPairs[pairs[j - 1] >> 8][0xFF & pairs[j - 1]] < c); j--) {
+      if(j < top) pairs[j] = pairs[j - 1];
+    }
+    if(j < top) pairs[j] = p;
+  }
+  fprintf(f, "# instr pairs\n");
+  for(U2 i = 0; i < len; i++) {
+    fprintf(f, "%14llu  ", histPairs[pairs[i] >> 8][0xFF & pairs[i]]);
+    histName(f, pairs[i] >> 8); fprintf(f, " "); histName(f, 0xFF & pairs[i]);
+    fprintf(f, "\n");
+  }
+}
+#endif // FNGI_HIST
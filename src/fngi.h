@@ -1,12 +1,93 @@
 #ifndef __FNGI_H
 #define __FNGI_H
 
+#include <stdatomic.h>
 #include "civ_unix.h"
 #include "const.h" // from gen/
 #include "spor.h"  // from gen/
 
 #define FNGI_VERSION "0.1.0"
 
+// Build options (i.e. `make DEFS="-DFNGI_THREADED"`):
+// * FNGI_THREADED: dispatch instrs with computed goto instead of a switch.
+// * FNGI_XCACHE: execute fns from a pre-decoded translation (XCell array).
+// * FNGI_TOS: cache the top of the working stack in a register while
+//   executing (implies FNGI_THREADED).
+// * FNGI_JIT: compile hot fns (FNGI_JIT_HOT calls) to native x86 code. Uses
+//   the default engine for everything else.
+// * FNGI_PROF: enable the SIGPROF sampling profiler (Kern_profStart).
+// * FNGI_STATS: count the calls, cycles and max RS depth of every fn (fnStats).
+// * FNGI_HIST: count executed instrs and pairs of adjacent instrs (histDump).
+//   Not with FNGI_XCACHE + FNGI_THREADED, which execute label addresses.
+// * FNGI_TRACE: print every executed instr and the WS (very slow).
+// * FNGI_FUEL: meter fibers per call and backward jmp, yielding or panicking
+//   when their budget runs out (FnFiber_setFuel). The JIT then only compiles
+//   fns without loops or fngi calls.
+// * FNGI_MT: allow a Kern per OS thread. The remaining process globals (fngiK,
+//   the JIT buffer and the FNGI_STATS/FNGI_HIST tables) become thread local.
+//   fngi's panics (SET_ERR/ASSERT) longjmp to the thread's fngiErrJmp instead
+//   of civ.fb's, which is a process global. fngi checks its own stacks so a
+//   Stk underflow is one of them; a thread must set fngiErrJmp before it runs
+//   its Kern. Other panics inside civ (i.e. an allocation) still go to civ.fb.
+//   Each Kern should get its own BA (Kern_initBA). The builtins (Ty_builtins)
+//   are constant and shared. The FNGI_PROF timer is per process, so only one
+//   Kern can be profiled and only samples on its own thread are kept.
+
+#ifdef FNGI_MT
+#define FNGI_TLS  _Thread_local
+#else
+#define FNGI_TLS
+#endif
+
+// Where a panic longjmps to, set by executeLoop and simpleRepl. civ.fb is a
+// process global, so with FNGI_MT fngi panics through its own per thread
+// pointer, which falls back to civ.fb->errJmp when unset.
+#ifdef FNGI_MT
+extern FNGI_TLS jmp_buf* fngiErrJmp;
+#define FNGI_ERRJMP  fngiErrJmp
+void fngiPanic(Slc err) __attribute__((noreturn));
+#undef  SET_ERR
+#define SET_ERR(E)  { fngiPanic(E); }
+#undef  ASSERT
+#define ASSERT(C, E)  do { if(not (C)) SET_ERR(Slc_ntLit(E)); } while(0)
+
+// civ's Stk_pop/Stk_add/Stk_top assert through civ.fb, so check them here.
+static inline S* fngiStkTopRef(Stk* stk) {
+  ASSERT(stk->sp < stk->cap, "Stk underflow"); return &stk->dat[stk->sp];
+}
+static inline S fngiStkPop(Stk* stk) {
+  S v = *fngiStkTopRef(stk); stk->sp += 1; return v;
+}
+static inline void fngiStkAdd(Stk* stk, S v) {
+  ASSERT(stk->sp, "Stk overflow"); stk->sp -= 1; stk->dat[stk->sp] = v;
+}
+#define Stk_pop(STK)     fngiStkPop(STK)
+#define Stk_add(STK, V)  fngiStkAdd(STK, V)
+#define Stk_top(STK)     (*fngiStkTopRef(STK))
+#define Stk_topRef(STK)  fngiStkTopRef(STK)
+
+// A handler of civ.fb's (i.e. a test's) also catches a panic from within
+// executeLoop, so it must restore fngiErrJmp too.
+#undef  EXPECT_ERR
+#define EXPECT_ERR(...) { \
+  jmp_buf* _fngiJ = fngiErrJmp; jmp_buf* _civJ = civ.fb->errJmp; \
+  jmp_buf _j; fngiErrJmp = NULL; civ.fb->errJmp = &_j; ERR_EXPECTED = true; \
+  if(not setjmp(_j)) { __VA_ARGS__; eprintf("!! expected err\n"); exit(3); } \
+  ERR_EXPECTED = false; civ.fb->errJmp = _civJ; fngiErrJmp = _fngiJ; }
+#else
+#define FNGI_ERRJMP  civ.fb->errJmp
+#endif
+
+#if defined(FNGI_TOS) && !defined(FNGI_THREADED)
+#define FNGI_THREADED
+#endif
+#if defined(FNGI_JIT) && (defined(FNGI_THREADED) || defined(FNGI_XCACHE))
+#error "FNGI_JIT single-steps with the default engine"
+#endif
+#if defined(FNGI_HIST) && defined(FNGI_XCACHE) && defined(FNGI_THREADED)
+#error "FNGI_HIST counts instr bytes"
+#endif
+
 #define SZR         SZ4
 
 #define WS_DEPTH    16
@@ -14,6 +95,15 @@
 #define TOKEN_SIZE  128
 #define DICT_DEPTH  10
 #define FN_ALLOC    256
+#define PEEP_DEPTH  8
+#define MATCH_MAX   64
+#define INLINE_MAX  12
+#define OPT_SLOTS   64
+#define TBL_BLOCKS  64   // max blocks of a Tbl
+#define BUILTIN_TBL 256  // power of 2, see etc/gen.py
+#define PROF_SAMPLES 4096
+#define PROF_DEPTH  32
+#define FN_STATS    1024
 
 #define SLIT_MAX    0x2F
 
@@ -83,6 +173,11 @@ typedef struct _TyI {
 
 typedef struct { TY_BODY; S v; TyI* tyI; } TyVar;
 
+#ifdef FNGI_XCACHE
+// A pre-decoded instr: handler (instr or FNGI_THREADED label) and operand.
+typedef struct { S h; S a; } XCell;
+#endif
+
 typedef struct {
   TY_BODY
   Ty* locals;
@@ -91,6 +186,13 @@ typedef struct {
   TyI* out;
   U2 len; // size of spor binary
   U1 lSlots;
+#ifdef FNGI_XCACHE
+  XCell* xc; // translation of code, see fnEp
+#endif
+#ifdef FNGI_JIT
+  void* jit; // native code, see fnJit
+  U2 calls;  // calls until hot, or JIT_NEVER
+#endif
 } TyFn;
 
 #define TyFn_native(CNAME, META, NFN, INP, OUT) {       \
@@ -138,13 +240,21 @@ typedef struct {
 } MSpReader;
 typedef struct { MSpReader* m; void* d; } SpReader;
 
-#define TYDB_DEPTH 16
+// The TyIs of the snapshots are interned (see TyI_intern) so they are never
+// freed and share their tails: pushing/popping a type is moving a pointer, and
+// so is cloning a snapshot. Dropped snapshots are kept in free for reuse, so
+// there is no depth limit.
+typedef struct _TySnap {
+  struct _TySnap* next;
+  TyI* tyI;
+  bool done; // whether block is ret/cont/break/etc
+} TySnap;
+
 typedef struct {
   BBA* bba;
-  Stk tyIs; // stack of TyI, aka blocks
-  Stk done; // indication of whether block is ret/cont/break/etc
-  S   tyIsDat[TYDB_DEPTH];
-  S   doneDat[TYDB_DEPTH];
+  TySnap* snap; // stack of snapshots, aka blocks
+  TySnap* free;
+  U2 len;
 } TyDb;
 
 // Flow Block (loop/while/etc)
@@ -157,7 +267,19 @@ typedef struct _Blk {
 } Blk;
 static inline Sll*  Blk_asSll(Blk* this)     { return (Sll*)this; }
 
-typedef struct { TyDict** dat;   U2 sp;   U2 cap;           } DictStk;
+typedef struct { TyDict** dat;   U2 sp;   U2 cap;   U2 gen;   } DictStk;
+
+// An open addressing hash table of sz byte entries in blocks of k->ba. An
+// entry is empty if it starts with a NULL pointer. See Tbl_reserve.
+typedef struct { U1* blk[TBL_BLOCKS]; U1 blkLen; U1 sz; U4 len; } Tbl;
+
+// An entry of the hashed index of dict children: ty (by key pointer) in d.
+typedef struct { TyDict* d; Ty* ty; } Sym;
+extern const Sym builtinSyms[BUILTIN_TBL]; // see gen/builtins.inc
+
+// Peephole window: start of the last ops compiled into code, which ends at
+// dat+end. It is only valid while code still ends there.
+typedef struct { U1* dat; U2 end; U2 i[PEEP_DEPTH]; U1 len; } Peep;
 
 typedef struct {
   U2 glen; U2 gcap; // global data used and cap
@@ -165,6 +287,7 @@ typedef struct {
   U2 cstate;
   U2 fnLocals; // locals size
   U1 fnState;
+  U1 opt;     // optimization level of N_fn, see optFn
   U1 logLvlSys;  U1 logLvlUsr;
   TyDict* curMod; // current parent module (mod, struct, etc)
   Ty* curTy;      // current type (fn, struct) being compiled
@@ -172,34 +295,107 @@ typedef struct {
   TyDict rootDict;
   TyDict* dictBuf[DICT_DEPTH];
   DictStk dictStk;    // Type is: &&Ty (double ref to dictionary)
+  Tbl names; Tbl syms; // of CStr* and Sym, see Kern_intern and Kern_findTy
+  Ty* tokenTy; U2 tokenTyGen; bool tokenTyOk; // lookup of the current token
   SpReader src;
   // Reader src;
-  FileInfo* srcInfo;
+  FileInfo* srcInfo; FileInfo replInfo;
   Buf token; U1 tokenDat[64]; U2 tokenLine;
-  Buf code;
-  TyDb tyDb; TyDb tyDbImm; BBA bbaTyImm;
+  Buf code; Peep peep;
+  TyDb tyDb; TyDb tyDbImm;
+  Tbl tyIIntern; // hash set of interned TyI*
   BBA* bbaDict;
   Blk* blk;
 } Globals;
 
-typedef struct {
+#define FIBER_READY    0
+#define FIBER_BLOCKED  1 // in join or parked on a chan
+#define FIBER_DONE     2
+
+// Spawned fiber sizes, see Kern_spawn. SMALL and MEDIUM carve the FnFiber and
+// its stacks out of a slab of BLOCK_SIZE / 16 and / 4 bytes. LARGE uses a block
+// for the stacks like FnFiber_init.
+#define FIBER_SMALL    0
+#define FIBER_MEDIUM   1
+#define FIBER_LARGE    2
+#define FIBER_CLASSES  3
+
+typedef struct _FnFiber {
   Fiber fb;
   U1* ep;             // execution pointer
   Stk ws; Stk rs;     // working and return stack
   Stk info;           // info stack
+  struct _FnFiber* next;    // in a FiberQ, a joiners list or a chan's parked
+  struct _FnFiber* joiners; // fibers blocked until this one is done
+  struct _Kern* kern;       // the Kern which runs it
+  struct _Chan* wait;       // parked on, see chanPark
+  S msg;                    // value being sent or received, see Chan
+  U1 state; U1 cls;         // FIBER_READY/etc and FIBER_SMALL/etc
+  bool waitSend;            // parked to send (else recv)
+  U2 id; U2 gen;            // see Kern_fiberHandle
+#ifdef FNGI_FUEL
+  U4 tick; U4 tickLen;      // metered until fuelOut, see FnFiber_setFuel
+  U4 fuel; U4 slice; U4 used;
+#endif
+#ifdef FNGI_STATS
+  void* stats;              // a frame per info entry, see statsEnter
+  U8 away; U8 awayAt;       // time switched out, see statsSwitch
+#endif
+#ifdef FNGI_XCACHE
+  XCell start[2];           // XL fn; RET, see Kern_spawn
+#else
+  U1 start[6];
+#endif
 } FnFiber;
 
-typedef struct {
+typedef struct { FnFiber* head; FnFiber* tail; } FiberQ; // FIFO through next
+
+// A bounded lock-free channel of (untyped) S values: a ring of cap cells, where
+// a cell's seq tells whether it is free for send position p (seq=2p) or holds
+// the value of p (seq=2p+1), even with one cell. Only one Kern (thread) may
+// recv. Only one may send to a SPSC chan, any number to a MPSC one (which
+// claim a cell with a CAS).
+// Fibers parked on a full or empty chan are woken by the counterpart op,
+// through their Kern's inbox if it is on another thread.
+typedef struct { _Atomic U4 seq; S v; } ChanCell;
+
+typedef struct _Chan {
+  U4 mask; bool mpsc;                // cap - 1 (cap is a power of 2)
+  _Atomic U4 tail; _Atomic U4 head;  // send and recv positions
+  _Atomic(FnFiber*) senders;         // parked fibers, see chanPark
+  _Atomic(FnFiber*) recvers;
+  _Atomic(struct _Kern*) sendK;      // the sending (SPSC) and receiving Kern
+  _Atomic(struct _Kern*) recvK;
+  struct _Kern* owner;               // allocated it, see Kern_chanFree
+  struct _Chan* next;                // in owner->chanPool once freed
+  ChanCell dat[];
+} Chan;
+
+typedef struct _Kern {
   U4 _null;
   bool isTest;
+  BA* ba;        // blocks of the BBAs and fibers
   BBA bbaCode;
   BBA bbaDict;
   BBA bbaRepl;
   Globals g;     // kernel globals
   FnFiber* fb;   // current fiber.
+  FiberQ ready;  // fibers to run after fb, see yield
+#ifdef FNGI_FUEL
+  U4 fuelSlice;  // slice of spawned fibers
+#endif
+  U1 loopDepth;  // nested executeLoops
+  FnFiber* fiberPool[FIBER_CLASSES]; // done fibers to reuse, by cls
+  Tbl fibers;    // FnFiber* by id, see Kern_fiberHandle
+  Chan* chanPool; // freed small chans to reuse, see Kern_chan
+  _Atomic(FnFiber*) inbox; // woken by other Kerns, see fiberWake
+  U2 parked;      // fibers parked on chans
+#ifdef FNGI_XCACHE
+  XCell* xcFree;  // translations of redefined fns to reuse, see xcFree
+#endif
 } Kern;
 
-extern Kern* fngiK;
+extern FNGI_TLS Kern* fngiK;
 
 extern MSpReader mSpReader_UFile;
 extern MSpReader mSpReader_BufFile;
@@ -216,27 +412,57 @@ void fngiErrPrinter();
 void fngiHandleSig(int sig, struct sigcontext ctx);
 
 void DictStk_reset(Kern* k);
-void Kern_init(Kern* k, FnFiber* fb);
+void Kern_init(Kern* k, FnFiber* fb); // uses civ.ba
+void Kern_initBA(Kern* k, BA* ba, FnFiber* fb);
+#if defined(FNGI_XCACHE) && defined(FNGI_THREADED)
+void xcInit(); // export executeInstr's labels for translations
+#endif
 
 // Initialze FnFiber (beyond Fiber init).
-bool FnFiber_init(FnFiber* fb);
+bool FnFiber_init(FnFiber* fb); // uses civ.ba
+bool FnFiber_initBA(FnFiber* fb, BA* ba);
+
+// Create a fiber which calls fn and add it to the ready queue. The fiber is
+// reused by a later spawn once it is done.
+FnFiber* Kern_spawn(Kern* k, TyFn* fn);
+
+// fngi code refers to a fiber by a handle of its id and generation. A spawn
+// which reuses a fiber starts a new generation, so the handles of its previous
+// use are stale: Kern_fiber returns NULL for them.
+S        Kern_fiberHandle(Kern* k, FnFiber* fb);
+FnFiber* Kern_fiber(Kern* k, S h);
+
+// The smallest FIBER_SMALL/etc whose stacks fit fn's static worst case.
+U1 fnFiberCls(TyFn* fn);
+
+#ifdef FNGI_FUEL
+#define FUEL_INF  0xFFFFFFFF
+// Every call and taken backward jmp costs a unit of fuel. When slice units
+// have been used the fiber yields (slice=0: never). When the fuel is used up
+// the fiber panics "out of fuel" and its fuel becomes FUEL_INF, so a handler
+// can run.
+void FnFiber_setFuel(FnFiber* fb, U4 fuel, U4 slice);
+U4 FnFiber_fuel(FnFiber* fb);     // remaining fuel
+U4 FnFiber_fuelUsed(FnFiber* fb); // total units used
+#endif
+
+// Create a channel of at least cap values (cap is rounded up to a power of 2).
+// Kern_chanFree frees it, on the same Kern and with no fiber parked on it.
+Chan* Kern_chan(Kern* k, S cap, bool mpsc);
+void  Kern_chanFree(Kern* k, Chan* ch);
+
+// Send/receive without blocking. Return false (and do nothing) if cfb would
+// have to block instead.
+bool Chan_trySend(Kern* k, Chan* ch, S v);
+bool Chan_tryRecv(Kern* k, Chan* ch, S* v);
 
 static inline U1* kFn(void(*native)(Kern*)) { return (U1*) native; }
 
-#define LOCAL_TYDB_BBA(NAME) \
-  BBA  bba_##NAME       = (BBA) { &civ.ba }; \
-  BBA* prevBba_##NAME   = k->g.NAME.bba;   \
-  k->g.NAME.bba     = &bba_##NAME;
-
-#define END_LOCAL_TYDB_BBA(NAME) \
-  BBA_drop(&bba_##NAME); \
-  k->g.NAME.bba     = prevBba_##NAME;
-
 #define REPL_START \
-  TyDb_new(&k->g.tyDb); LOCAL_TYDB_BBA(tyDb);
+  TyDb_new(&k->g.tyDb);
 
 #define REPL_END \
-  TyDb_drop(k, &k->g.tyDb); END_LOCAL_TYDB_BBA(tyDb); \
+  TyDb_drop(k, &k->g.tyDb); \
   DictStk_reset(k);
 
 
@@ -245,6 +471,48 @@ static inline U1* kFn(void(*native)(Kern*)) { return (U1*) native; }
 // # Execute
 
 void executeFn(Kern* k, TyFn* fn);
+U1 instrLitSz(U1 instr);
+I4 jmpTarget(U1* code, I4 i); // the index the jmp at code[i] jumps to
+void xImpl(Kern* k, Ty* ty);
+void ret(Kern* k);
+
+// Push the frame of fn (as XL does), returning the locals.
+U1* fnEnter(Kern* k, TyFn* fn);
+
+// AOT: emit the fns of dict as a C translation unit which defines
+// `U2 <name>_load(Kern* k, TyDict* dict)`. Compile it into the binary and call
+// that after compiling the same source to make those fns native. Returns the
+// number of fns emitted.
+U2 Kern_aot(Kern* k, FILE* f, TyDict* dict, char* name);
+
+typedef struct { CStr* name; void(*c)(Kern*); TyFn** fn; U2 len; U1 lSlots; } AotFn;
+typedef struct { CStr* name; bool call; } AotRef;
+U2 Kern_aotLoad(Kern* k, TyDict* dict, AotFn* fns, AotRef* refs, Ty** r);
+
+#ifdef FNGI_PROF
+// Sample k's fngi call stack every usec of CPU time (SIGPROF) until
+// Kern_profStop, which writes the samples to f (if not NULL) as folded stacks
+// (`fnA+off;fnB+off count`, i.e. for flamegraph.pl) and returns their count.
+void Kern_profStart(Kern* k, U4 usec);
+U4   Kern_profStop(Kern* k, FILE* f);
+#endif
+
+#ifdef FNGI_STATS
+// Stats of fns called through fnEnter (so not native fns). Cycles are from
+// rdtsc. maxRs is in slots. From fngi: `comp.fnStats myFn` -> calls incl excl
+// maxRs.
+typedef struct { TyFn* fn; U4 calls; U2 active, maxRs; U8 incl, excl; } FnStats;
+FnStats* fnStats(TyFn* fn); // NULL if fn was never called
+void     fnStatsClear();
+void     fnStatsDump(FILE* f); // sorted by excl
+#endif
+
+#ifdef FNGI_HIST
+// Executed instrs (SLITs are all counted as SLIT) and pairs [first][second].
+extern FNGI_TLS U8 histOps[0x100]; extern FNGI_TLS U8 histPairs[0x100][0x100];
+void histClear();
+void histDump(FILE* f, U2 top); // all instrs and the top pairs, by count
+#endif
 
 // #################################
 // # Scan
@@ -282,6 +550,10 @@ static inline bool isDictNative(TyDict* ty)    IS_DICT(TY_DICT_NATIVE)
 static inline bool isDictMod(TyDict* ty)       IS_DICT(TY_DICT_MOD)
 static inline bool isDictStruct(TyDict* ty)    IS_DICT(TY_DICT_STRUCT)
 #undef IS_DICT
+// dictStk may also hold a TyFn (its locals)
+static inline bool isDictBuiltin(TyDict* ty) {
+  return isTyDict((Ty*)ty) and (TY_DICT_BUILTIN & ty->meta);
+}
 static inline bool isVarGlobal(TyVar* v) { return TY_VAR_GLOBAL & v->meta; }
 static inline U1   TyI_refs(TyI* tyI) { return TY_REFS & tyI->meta; }
 
@@ -302,9 +574,13 @@ static inline TyVar* tyVar(Ty* ty) {
 }
 
 Ty* Kern_findTy(Kern* k, Slc t);
+Ty* Kern_findName(Kern* k, CStr* name); // name must be interned
+Ty* Kern_findIn(Kern* k, TyDict* d, Slc s);
+Ty* TyDict_findName(Kern* k, TyDict* d, CStr* name);
+CStr* Kern_intern(Kern* k, Slc s, CStr* key);
 void Kern_addTy(Kern* k, Ty* ty);
+Ty* Ty_new(Kern* k, U2 meta, CStr* key); // key=NULL: the next token
 
-void Kern_fns(Kern* k);
 void single(Kern* k, bool asImm);
 void compileSrc(Kern* k);
 
@@ -377,38 +653,36 @@ void executeInstrs(Kern* k, U1* instrs);
 
 void simpleRepl(Kern* k);
 
-// Get the current snapshot
+// Get the snapshot at depth i (0 is the current one)
 static inline TyI* TyDb_index(TyDb* db, U2 i) {
-  ASSERT(i < Stk_len(&db->tyIs), "TyDb OOB index");
-  return (TyI*) db->tyIs.dat[db->tyIs.sp + i];
+  ASSERT(i < db->len, "TyDb OOB index");
+  TySnap* s = db->snap; while(i--) s = s->next;
+  return s->tyI;
 }
 
-static inline TyI* TyDb_top(TyDb* db) { return (TyI*) Stk_top(&db->tyIs); }
-
-// Get a reference to the current snapshot
-static inline TyI** TyDb_root(TyDb* db) { return (TyI**) Stk_topRef(&db->tyIs); }
+static inline TyI* TyDb_top(TyDb* db) { return db->snap->tyI; }
 
 // Get a reference to the current snapshot
-static inline Sll** TyDb_rootSll(TyDb* db) { return (Sll**) Stk_topRef(&db->tyIs); }
+static inline TyI** TyDb_root(TyDb* db) { return &db->snap->tyI; }
 
 // Get/set whether current snapshot is done (guaranteed ret)
-static inline bool TyDb_done(TyDb* db) { return Stk_top(&db->done); }
-static inline void TyDb_setDone(TyDb* db, bool done) { *Stk_topRef(&db->done) = done; }
+static inline bool TyDb_done(TyDb* db) { return db->snap->done; }
+static inline void TyDb_setDone(TyDb* db, bool done) { db->snap->done = done; }
 
-// Free from the current snapshot.
+// Pop from the current snapshot.
 //
-// "stream" can be either TyDb_top (freeing the entire snapshot), or a
+// "stream" can be either TyDb_top (emptying the entire snapshot), or a
 // separate type stream which indicates the length of items to drop.
 void TyDb_free(Kern* k, TyDb* db, TyI* stream);
 
+// Get the interned TyI with node's type and name followed by next.
+TyI* TyI_intern(Kern* k, TyI* node, TyI* next);
+
 // Drop the current snapshot
 void TyDb_drop(Kern* k, TyDb* db);
 
-// Create a new snapshot
-static inline void TyDb_new(TyDb* db) {
-  Stk_add(&db->tyIs, 0);
-  Stk_add(&db->done, false);
-}
+// Create a new (empty) snapshot
+void TyDb_new(TyDb* db);
 
 static inline TyDb* tyDb(Kern* k, bool asImm) { return asImm ? &k->g.tyDbImm : &k->g.tyDb; }
 void tyCheck(TyI* require, TyI* given, bool sameLen, Slc errCxt);
@@ -416,6 +690,7 @@ void tyCall(Kern* k, TyDb* db, TyI* inp, TyI* out);
 void tyRet(Kern* k, TyDb* db, bool done);
 void tySplit(Kern* k);
 void tyMerge(Kern* k, TyDb* db);
+void tyClone(Kern* k, TyDb* db, U2 depth); // continue on a copy of the snapshot at depth
 void TyI_printAll(TyI* tyI);
 Ty* TyDict_find(TyDict* dict, Slc s);
 
@@ -423,6 +698,7 @@ Ty* TyDict_find(TyDict* dict, Slc s);
 #define TYI_VOID  NULL
 
 #define TYIS(PRE) \
+  PRE TyDict  Ty_builtins; \
   PRE TyDict  Ty_UNSET;    \
   PRE TyDict  Ty_Any;      \
   PRE TyDict  Ty_Unsafe;   \
@@ -439,6 +715,7 @@ Ty* TyDict_find(TyDict* dict, Slc s);
   PRE TyDict  Ty_I2;     \
   PRE TyDict  Ty_I4;     \
   PRE TyDict  Ty_SI;     \
+  PRE TyDict  Ty_Chan;   \
   PRE TyI TyIs_S;      /* S          */ \
   PRE TyI TyIs_SS;     /* S, S       */ \
   PRE TyI TyIs_SSS;    /* S, S, S    */ \
@@ -450,6 +727,8 @@ Ty* TyDict_find(TyDict* dict, Slc s);
   PRE TyI TyIs_rU2;    /* &U2        */ \
   PRE TyI TyIs_rU4;    /* &U4        */ \
   PRE TyI TyIs_rU1_U4; /* &U1, U4    */ \
+  PRE TyI TyIs_Chan;   /* Chan       */ \
+  PRE TyI TyIs_ChanS;  /* Chan, S    */ \
 
 TYIS(extern)
 
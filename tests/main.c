@@ -1,5 +1,8 @@
 
 #include "fngi.h"
+#ifdef FNGI_MT
+#include <pthread.h>
+#endif
 
 TEST(basic)
   TASSERT_EQ(7,    cToU1('7'));
@@ -46,6 +49,14 @@ TEST_FNGI(call, 1)
   TASSERT_EMPTY();
 END_TEST_FNGI
 
+TEST_FNGI(wsOverflow, 1) // a panic leaves all of WS, even a cached top
+  U1 flood[] = { SLIT + 1, SZ1 + JL, 0xFE }; // loop: push 1
+  k->g.srcInfo = &k->g.replInfo; // for the uncaught panic message
+  EXPECT_ERR(XFN(flood, 0, 0));
+  TASSERT_EQ(WS->cap, Stk_len(WS));
+  TASSERT_WS(1); Stk_clear(WS);
+END_TEST_FNGI
+
 #define TASSERT_TOKEN(T) \
   tokenDrop(k); scan(k); \
   TASSERT_SLC_EQ(T, *Buf_asSlc(&k->g.token));
@@ -65,7 +76,6 @@ Slc testCxt = SLC("test");
 
 TEST_FNGI(compile0, 4)
   k->g.fnState |= C_UNTY;
-  Kern_fns(k);
   TASSERT_EMPTY();
 
   // Very explicit memory layout
@@ -93,14 +103,12 @@ END_TEST_FNGI
 
 TEST_FNGI(inlineFns, 4)
   k->g.fnState |= C_UNTY;
-  Kern_fns(k);
   COMPILE_EXEC("swp(1, 4)");    TASSERT_WS(1); TASSERT_WS(4);
 
   TASSERT_EMPTY();
 END_TEST_FNGI
 
 TEST_FNGI(compile1, 10)
-  Kern_fns(k);
   k->g.fnState |= C_UNTY;
 
   COMPILE_EXEC("fn maths do (_ + 7 + (3 * 5))  maths(4)"); TASSERT_WS(26);
@@ -136,15 +144,11 @@ TEST_FNGI(compile1, 10)
 END_TEST_FNGI
 
 TEST_FNGI(comment, 10)
-  Kern_fns(k);
   COMPILE_EXEC("\\1 \\(foo bar) \\(3 4 5)\n\\ 1 2 3 this is a line\n\\3");
   TASSERT_EQ(0, Stk_len(WS));
 END_TEST_FNGI
 
 TEST_FNGI(tyDb, 4)
-  Kern_fns(k);
-  LOCAL_TYDB_BBA(tyDb);
-
   TY_CHECK(&TyIs_S, &TyIs_S,  false);
   TY_CHECK(&TyIs_S, &TyIs_S,  true);
   TY_CHECK(&TyIs_S, &TyIs_SS, false);
@@ -167,11 +171,34 @@ TEST_FNGI(tyDb, 4)
   tyCall(k, db, NULL, &TyIs_S);
   tyRet(k, db, true);  TASSERT_EQ(true, TyDb_done(db));
   EXPECT_ERR(tyCall(k, db, &TyIs_S, NULL));
-  END_LOCAL_TYDB_BBA(tyDb);
+
+  // The same types are the same (interned) nodes, so no new ones are needed
+  TyDb_new(db);
+  tyCall(k, db, NULL, &TyIs_SS); TyI* ss = TyDb_top(db); U4 len = k->g.tyIIntern.len;
+  tyCall(k, db, &TyIs_S, NULL);  tyCall(k, db, NULL, &TyIs_S);
+  TASSERT_EQ(ss, TyDb_top(db));
+  tyClone(k, db, 0); tyCall(k, db, &TyIs_SS, &TyIs_SS);
+  TASSERT_EQ(ss, TyDb_top(db));
+  TASSERT_EQ(len, k->g.tyIIntern.len);
+  TyDb_drop(k, db); TyDb_drop(k, db);
+END_TEST_FNGI
+
+TEST_FNGI(tyIIntern, 20)
+  // past the first block the table grows, and nodes are still shared
+  TyI* n[2000];
+  for(U2 i = 0; i < 2000; i++) {
+    TyI node = { .ty = (Ty*)(S)(4 * i + 4) }; n[i] = TyI_intern(k, &node, NULL);
+  }
+  TASSERT_EQ(2000, k->g.tyIIntern.len);
+  TASSERT_EQ(4, k->g.tyIIntern.blkLen);
+  for(U2 i = 0; i < 2000; i++) {
+    TyI node = { .ty = (Ty*)(S)(4 * i + 4) };
+    TASSERT_EQ(n[i], TyI_intern(k, &node, NULL));
+  }
+  TASSERT_EQ(2000, k->g.tyIIntern.len);
 END_TEST_FNGI
 
 TEST_FNGI(compileTy, 6)
-  Kern_fns(k);
   REPL_START
   COMPILE_EXEC("fn pop2    a:U1 b:U2 c:S -> \\a:U1  do (a)");
   COMPILE_EXEC("fn pop2_ stk:U1 b:U2 c:S -> \\a:U1  do (_)");
@@ -182,7 +209,6 @@ END_TEST_FNGI
 
 #define TY_LEN  Sll_len((Sll*)TyDb_top(&k->g.tyDb))
 TEST_FNGI(compileIf, 10)
-  Kern_fns(k);
   REPL_START
   k->g.fnState |= C_UNTY;
 
@@ -249,12 +275,18 @@ TEST_FNGI(compileIf, 10)
   // EXPECT_ERR(COMPILE_EXEC("fn bad -> S do (" IF_ALL_RET "4 )"));
   // TyDb_drop(k); // panic means cleanup wasn't handled
 
+  // deeper than the old fixed TyDb depth (16)
+  #define IF_DEEP1(X) "if(a) do (" X ") else 0"
+  #define IF_DEEP4(X) IF_DEEP1(IF_DEEP1(IF_DEEP1(IF_DEEP1(X))))
+  COMPILE_EXEC("fn deep a:S -> S do (" IF_DEEP4(IF_DEEP4(IF_DEEP4(IF_DEEP4(IF_DEEP4("1"))))) ")");
+  COMPILE_EXEC("tAssertEq(1, deep(3))  tAssertEq(0, deep(0))");
+  TASSERT_EQ(1, k->g.tyDb.len);
+
   REPL_END
-  TASSERT_EQ(0, Stk_len(&k->g.tyDb.tyIs));
+  TASSERT_EQ(0, k->g.tyDb.len);
 END_TEST_FNGI
 
 TEST_FNGI(compileBlk, 10)
-  Kern_fns(k);
   REPL_START
   TASSERT_EQ(0, k->g.fnState & C_UNTY);
 
@@ -265,11 +297,11 @@ TEST_FNGI(compileBlk, 10)
       ")"); TASSERT_WS(0x15);
 
   REPL_END
-  TASSERT_EQ(0, Stk_len(&k->g.tyDb.tyIs));
+  TASSERT_EQ(0, k->g.tyDb.len);
 END_TEST_FNGI
 
 TEST_FNGI(compileVar, 10)
-  Kern_fns(k); REPL_START;
+  REPL_START;
   COMPILE_EXEC(
       "fn useVar stk:S -> S do (\n"
       "  var a: S = (_ + 7);  ret inc(a);\n"
@@ -293,7 +325,7 @@ TEST_FNGI(compileVar, 10)
 END_TEST_FNGI
 
 TEST_FNGI(compileStruct, 10)
-  Kern_fns(k); REPL_START;
+  REPL_START;
 
   COMPILE_EXEC(
       "fn chTy stk:S -> U2 do ( ret U2; )"
@@ -327,7 +359,7 @@ TEST_FNGI(compileStruct, 10)
 END_TEST_FNGI
 
 TEST_FNGI(structBrackets, 10)
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("struct A [ a1: S, a2: S ]");
   COMPILE_EXEC("struct B [ b1: A, b2: S ]");
   COMPILE_EXEC("fn buildA -> A do ( var a: A = { a1 = 0x33  a2 = 0x22 } a )")
@@ -347,8 +379,305 @@ TEST_FNGI(structBrackets, 10)
   REPL_END
 END_TEST_FNGI
 
+bool fnHasInstr(TyFn* fn, U1 instr) {
+  for(U2 i = 0; i < fn->len; i += 1 + instrLitSz(fn->code[i])) {
+    if(instr == fn->code[i]) return true;
+  }
+  return false;
+}
+
+TEST_FNGI(peephole, 10)
+  REPL_START
+  COMPILE_EXEC("fn addNe a:S b:S -> S do ( if(a == b) do ret 0; a + b )");
+  TyFn* addNe = tyFn(Kern_findTy(k, SLC("addNe")));
+  TASSERT_EQ(true, fnHasInstr(addNe, SZ4 | SRFTLL));
+  TASSERT_EQ(true, fnHasInstr(addNe, SZ1 | JNE));
+  TASSERT_EQ(true, fnHasInstr(addNe, ADDLL));
+  COMPILE_EXEC("tAssertEq(7, addNe(3, 4))  tAssertEq(0, addNe(2, 2))");
+  COMPILE_EXEC("fn add2 a:S b:S -> S do ( a + b )  tAssertEq(7, add2(3, 4))");
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("add2"))), ADDLL));
+
+  COMPILE_EXEC("fn addI a:S -> S do ( a + 0x20 )  tAssertEq(0x23, addI(3))");
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("addI"))), ADDI));
+
+  COMPILE_EXEC("struct A [ a1: S, a2: S ]  struct B [ b1: A, b2: S ]");
+  COMPILE_EXEC("fn clrB -> B do (\n"
+               "  var b: B = { b1 = { a1 = 1  a2 = 2 }  b2 = 3 }\n"
+               "  b.b1 = { a2 = 5 }  b\n"
+               ")");
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("clrB"))), LRCLR));
+  COMPILE_EXEC("clrB()"); TASSERT_WS(3); TASSERT_WS(5); TASSERT_WS(0);
+
+  COMPILE_EXEC("fn ftA a:&A -> S do ( a.a1 + (a.a2) )");
+  COMPILE_EXEC("fn ftA1 -> S do ( var a: A = { a1 = 7  a2 = 9 }  ftA(&a) )");
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("ftA"))), SZ4 | FTLO));
+  COMPILE_EXEC("tAssertEq(0x10, ftA1())");
+
+  COMPILE_EXEC("fn konst -> S do ( (4 + 8) shl 1 + (1 shl 5) + dec(0) )");
+  TyFn* konst = tyFn(Kern_findTy(k, SLC("konst")));
+  TASSERT_EQ(true, not fnHasInstr(konst, ADD) and not fnHasInstr(konst, SHL));
+  TASSERT_EQ(true, fnHasInstr(konst, SZ1 | LIT));
+  COMPILE_EXEC("tAssertEq(0x37, konst())");
+  COMPILE_EXEC("fn divZ a:S -> S do ( a / 0 )");
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("divZ"))), DIV_U));
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(inlineUser, 10)
+  REPL_START
+  COMPILE_EXEC("fn sq a:S -> S do ( a * a )"); // small, so inlined
+  COMPILE_EXEC("fn sumSq a:S b:S -> S do ( sq(a) + sq(b) )");
+  TyFn* sumSq = tyFn(Kern_findTy(k, SLC("sumSq")));
+  TASSERT_EQ(false, fnHasInstr(sumSq, XL) or fnHasInstr(sumSq, XLT));
+  TASSERT_EQ(4, sumSq->lSlots); // a b + each sq's a
+  COMPILE_EXEC("tAssertEq(25, sumSq(3, 4))");
+
+  COMPILE_EXEC("inline fn big a:S -> S do (\n"
+               "  var b: S = (a + 7)\n"
+               "  var c: S = (b * 3)\n"
+               "  c - a + b\n"
+               ")");
+  COMPILE_EXEC("fn useBig a:S -> S do ( big(a) + big(dec(a)) )");
+  TASSERT_EQ(false, fnHasInstr(tyFn(Kern_findTy(k, SLC("useBig"))), XL));
+  COMPILE_EXEC("tAssertEq(65, useBig(2))  tAssertEq(34, big(2))");
+
+  COMPILE_EXEC("fn early a:S -> S do ( if(a == 0) do ret 0; inc(a) )");
+  COMPILE_EXEC("fn useEarly a:S -> S do ( early(a) + 1 )"); // has a RET, so called
+  TASSERT_EQ(true, fnHasInstr(tyFn(Kern_findTy(k, SLC("useEarly"))), XL));
+  COMPILE_EXEC("tAssertEq(1, useEarly(0))  tAssertEq(5, useEarly(3))");
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(optimize, 10)
+  REPL_START
+  COMPILE_EXEC("fn cp0 a:S -> S do ( var b: S = 5; var c: S = (b * 3); var d: S = a; d + c )");
+  COMPILE_EXEC("imm#comp.setOpt(1)");
+  TASSERT_EQ(1, k->g.opt);
+  COMPILE_EXEC("fn cp1 a:S -> S do ( var b: S = 5; var c: S = (b * 3); var d: S = a; d + c )");
+  TyFn* cp0 = tyFn(Kern_findTy(k, SLC("cp0")));
+  TyFn* cp1 = tyFn(Kern_findTy(k, SLC("cp1")));
+  TASSERT_EQ(true, fnHasInstr(cp0, MUL));
+  TASSERT_EQ(false, fnHasInstr(cp1, MUL) or fnHasInstr(cp1, DRP));
+  TASSERT_EQ(true, fnHasInstr(cp1, ADDI)); // a + 15
+  TASSERT_EQ(true, cp1->len < cp0->len);
+  COMPILE_EXEC("tAssertEq(16, cp0(1))  tAssertEq(16, cp1(1))");
+
+  COMPILE_EXEC("fn sr a:S -> S do ( (a * 8) + (a / 4) + (a % 16) + (a * 1) )");
+  TyFn* sr = tyFn(Kern_findTy(k, SLC("sr")));
+  TASSERT_EQ(false, fnHasInstr(sr, MUL) or fnHasInstr(sr, DIV_U) or fnHasInstr(sr, MOD));
+  TASSERT_EQ(true, fnHasInstr(sr, SHL) and fnHasInstr(sr, SHR) and fnHasInstr(sr, MSK));
+  COMPILE_EXEC("tAssertEq(347, sr(37))");
+
+  // redundant loads of a local and of a field become DUP
+  COMPILE_EXEC("fn sq a:S -> S do ( var b: S = (a + 1); b * b )");
+  COMPILE_EXEC("struct OptPt [ x: S; y: S ]");
+  COMPILE_EXEC("fn sqX p:&OptPt -> S do ( p.x * (p.x) )");
+  TyFn* sq = tyFn(Kern_findTy(k, SLC("sq")));
+  TyFn* sqX = tyFn(Kern_findTy(k, SLC("sqX")));
+  TASSERT_EQ(true, fnHasInstr(sq, DUP) and fnHasInstr(sqX, DUP));
+  COMPILE_EXEC("tAssertEq(16, sq(3))");
+  COMPILE_EXEC("fn sqPt -> S do ( var pt: OptPt = OptPt(5, 6); sqX(&pt) )");
+  COMPILE_EXEC("tAssertEq(25, sqPt())");
+
+  // values are forgotten at labels (the loop head)
+  COMPILE_EXEC("fn sumTo n:S -> S do (\n"
+               "  var s: S = 0\n"
+               "  blk( if(n == 0) do brk s;  s = (s + n);  n = dec(n);  cont; )\n"
+               ")");
+  COMPILE_EXEC("tAssertEq(5050, sumTo(100))");
+  REPL_END
+END_TEST_FNGI
+
+// Whether every jmp of fn is SZ1 and none jumps to a JL.
+bool fnJmpsRelaxed(TyFn* fn) {
+  for(U2 i = 0; i < fn->len; i += 1 + instrLitSz(fn->code[i])) {
+    U1 base = ~SZ_MASK & fn->code[i];
+    if((fn->code[i] >= SLIT) or ((JL != base) and (JLZ != base) and (JNE != base))) continue;
+    if(SZ1 != (SZ_MASK & fn->code[i])) return false;
+    I4 to = jmpTarget(fn->code, i);
+    if((to < fn->len) and (JL == (~SZ_MASK & fn->code[to]))) return false;
+  }
+  return true;
+}
+
+TEST_FNGI(relaxJmps, 10)
+  REPL_START
+  COMPILE_EXEC("fn both a:S -> S do ( if(a) do ret 1 else ret 2 )");
+  TyFn* both = tyFn(Kern_findTy(k, SLC("both")));
+  TASSERT_EQ(false, fnHasInstr(both, SZ1 | JL) or fnHasInstr(both, SZ2 | JL)); // dead
+  TASSERT_EQ(true, fnJmpsRelaxed(both));
+  COMPILE_EXEC("tAssertEq(1, both(5))  tAssertEq(2, both(0))");
+
+  COMPILE_EXEC("fn nest a:S b:S -> S do ( if(a) do ( if(b) do 1 else 2 ) else 3 )");
+  TASSERT_EQ(true, fnJmpsRelaxed(tyFn(Kern_findTy(k, SLC("nest")))));
+  COMPILE_EXEC("tAssertEq(1, nest(1, 1))  tAssertEq(2, nest(1, 0))  tAssertEq(3, nest(0, 1))");
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(hotLoop, 10)
+  REPL_START
+  COMPILE_EXEC("fn sumTo n:S -> S do (\n"
+               "  var s: S = 0\n"
+               "  blk( if(n == 0) do brk s;  s = (s + n);  n = dec(n);  cont; )\n"
+               ")");
+  for(U2 i = 0; i < 100; i++) { COMPILE_EXEC("tAssertEq(15, sumTo(5))"); }
+  COMPILE_EXEC("tAssertEq(5050, sumTo(100))");
+#if defined(FNGI_JIT) && !defined(FNGI_FUEL)
+  TASSERT_EQ(true, NULL != tyFn(Kern_findTy(k, SLC("sumTo")))->jit);
+#endif
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(hotMutual, 10)
+  REPL_START
+  // fns are defined before use: point ev at od by hand. od0 recurses so that
+  // it is not inlined.
+  COMPILE_EXEC("fn od0 n:S -> S do ( if(n == 0) do ret 0; od0(dec(n)) )");
+  COMPILE_EXEC("fn ev n:S -> S do ( if(n == 0) do ret 1; od0(dec(n)) )");
+  COMPILE_EXEC("fn od n:S -> S do ( if(n == 0) do ret 0; ev(dec(n)) )");
+  TyFn* ev = tyFn(Kern_findTy(k, SLC("ev")));
+  TyFn* od = tyFn(Kern_findTy(k, SLC("od")));
+  TyFn* od0 = tyFn(Kern_findTy(k, SLC("od0")));
+  for(U2 i = 0; i + 5 <= ev->len; i++) {
+    if(((XL == ev->code[i]) or (XLT == ev->code[i]))
+       and ((S)od0 == ftBE(ev->code + i + 1, 4))) srBE(ev->code + i + 1, 4, (S)od);
+  }
+  for(U2 i = 0; i < 100; i++) { COMPILE_EXEC("tAssertEq(1, ev(6))"); }
+  COMPILE_EXEC("tAssertEq(0, ev(7))");
+  COMPILE_EXEC("tAssertEq(1, od(7))");
+#if defined(FNGI_JIT) && !defined(FNGI_FUEL)
+  TASSERT_EQ(true, NULL != ev->jit);
+  TASSERT_EQ(true, NULL != od->jit);
+#endif
+  REPL_END
+END_TEST_FNGI
+
+#ifdef FNGI_PROF
+TEST_FNGI(prof, 10)
+  REPL_START
+  COMPILE_EXEC("fn spin n:S -> S do (\n"
+               "  var s: S = 0\n"
+               "  blk( if(n == 0) do brk s;  s = (s + n);  n = dec(n);  cont; )\n"
+               ")");
+  COMPILE_EXEC("fn work n:S -> S do ( spin(n) + 1 )");
+  FILE* f = fopen("/dev/null", "w"); U4 samples = 0;
+  for(U2 i = 0; (i < 3) and not samples; i++) { // JIT'd spin is fast
+    Kern_profStart(k, 1000);
+    if(i == 0)      { COMPILE_EXEC("work(0x4000)"); }
+    else if(i == 1) { COMPILE_EXEC("work(0x400000)"); }
+    else            { COMPILE_EXEC("work(0x4000000)"); }
+    WS_POP();
+    samples = Kern_profStop(k, f);
+  }
+  fclose(f);
+  TASSERT_EQ(true, samples > 0);
+  REPL_END
+END_TEST_FNGI
+#endif
+
+#ifdef FNGI_STATS
+TEST_FNGI(fnStats, 10)
+  REPL_START; fnStatsClear();
+  COMPILE_EXEC("fn leaf a:S -> S do ( if(a == 0) do ret 0; a + 1 )"); // not inlined
+  COMPILE_EXEC("fn mid a:S -> S do ( leaf(a) + leaf(a) )");
+  COMPILE_EXEC("fn sum n:S -> S do ( if(n == 0) do ret 0; n + sum(dec(n)) )");
+  COMPILE_EXEC("tAssertEq(12, mid(5))  tAssertEq(15, sum(5))");
+  FnStats* leaf = fnStats(tyFn(Kern_findTy(k, SLC("leaf"))));
+  FnStats* mid  = fnStats(tyFn(Kern_findTy(k, SLC("mid"))));
+  FnStats* sum  = fnStats(tyFn(Kern_findTy(k, SLC("sum"))));
+  TASSERT_EQ(2, leaf->calls); TASSERT_EQ(1, mid->calls); TASSERT_EQ(6, sum->calls);
+  TASSERT_EQ(true, mid->incl == mid->excl + leaf->incl);
+  TASSERT_EQ(true, sum->incl == sum->excl); // recursion is counted once
+  TASSERT_EQ(true, sum->maxRs > leaf->maxRs);
+  COMPILE_EXEC("comp.fnStats leaf;  drp; drp; drp;  tAssertEq(2)");
+  fnStatsDump(stderr);
+
+  // fibers keep their own frames: interleaved calls don't mix
+  COMPILE_EXEC("fn pause a:S -> S do ( if(a == 0) do ret 0; yld; a + 1 )");
+  COMPILE_EXEC("fn inner do ( tAssertEq(3, pause(2));  tAssertEq(0, pause(0)) )");
+  COMPILE_EXEC("fn outer do ( inner(); inner(); inner() )");
+  COMPILE_EXEC("fn run do ( var fa:S = spawn outer; var fb:S = spawn inner; join fa; join fb )");
+  COMPILE_EXEC("run;");
+  FnStats* pause = fnStats(tyFn(Kern_findTy(k, SLC("pause"))));
+  FnStats* inner = fnStats(tyFn(Kern_findTy(k, SLC("inner"))));
+  FnStats* outer = fnStats(tyFn(Kern_findTy(k, SLC("outer"))));
+  TASSERT_EQ(8, pause->calls); TASSERT_EQ(0, pause->active);
+  TASSERT_EQ(4, inner->calls); TASSERT_EQ(0, inner->active);
+  TASSERT_EQ(true, inner->incl == inner->excl + pause->incl);
+  TASSERT_EQ(true, outer->incl > outer->excl);
+  REPL_END
+END_TEST_FNGI
+#endif
+
+#ifdef FNGI_HIST
+TEST_FNGI(hist, 10)
+  REPL_START
+  COMPILE_EXEC("fn dbl a:S -> S do ( a + a )");
+  histClear();
+  COMPILE_EXEC("tAssertEq(8, dbl(dbl(2)))");
+  U8 ops = 0, pairs = 0;
+  for(U2 i = 0; i < 0x100; i++) {
+    ops += histOps[i];
+    for(U2 j = 0; j < 0x100; j++) pairs += histPairs[i][j];
+  }
+  TASSERT_EQ(true, ops == pairs);
+  TASSERT_EQ(true, histOps[RET] >= 1); // dbl may be JIT'd
+  TASSERT_EQ(true, histOps[SLIT] >= 2);
+  histDump(stderr, 8);
+  REPL_END
+END_TEST_FNGI
+#endif
+
+TEST_FNGI(tailCall, 10)
+  REPL_START
+  COMPILE_EXEC("fn down n:S -> S do ( if(n == 0) do ret 0x42; down(dec(n)) )");
+  COMPILE_EXEC("tAssertEq(0x42, down(1000))"); // deeper than RS_DEPTH
+  COMPILE_EXEC("fn add3 a:S b:S c:S -> S do ( a + (b + c) )");
+  COMPILE_EXEC("fn addTo a:S -> S do ( add3(a, 1, 2) )  tAssertEq(7, addTo(4))");
+  COMPILE_EXEC("fn ftRef a:&S -> S do ( @a )");
+  COMPILE_EXEC("fn useRef a:S -> S do ( ftRef(&a) )  tAssertEq(5, useRef(5))");
+  TASSERT_EQ(true,  fnHasInstr(tyFn(Kern_findTy(k, SLC("down"))), XLT));
+  TASSERT_EQ(true,  fnHasInstr(tyFn(Kern_findTy(k, SLC("addTo"))), XLT));
+  TASSERT_EQ(false, fnHasInstr(tyFn(Kern_findTy(k, SLC("useRef"))), XLT));
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(match, 10)
+  REPL_START
+  COMPILE_EXEC("fn dense x:S -> S do (\n"
+               "  match(x) case 3 do 0x30  case 4 do 0x40  case 6 do 0x60\n"
+               "    case 5 do 0x50  else 0xEE\n"
+               ")");
+  COMPILE_EXEC("tAssertEq(0x30, dense(3))  tAssertEq(0x50, dense(5))");
+  COMPILE_EXEC("tAssertEq(0x60, dense(6))  tAssertEq(0xEE, dense(7))");
+  COMPILE_EXEC("tAssertEq(0xEE, dense(2))  tAssertEq(0xEE, dense(0))");
+  COMPILE_EXEC("fn sparse x:S -> S do (\n"
+               "  match(x) case 1 do 1  case 0x100 do 2  case 7 do 3\n"
+               "    case 0x1000 do 4  case 50 do 5  else 0\n"
+               ")");
+  COMPILE_EXEC("tAssertEq(1, sparse(1))     tAssertEq(2, sparse(0x100))");
+  COMPILE_EXEC("tAssertEq(3, sparse(7))     tAssertEq(4, sparse(0x1000))");
+  COMPILE_EXEC("tAssertEq(5, sparse(50))    tAssertEq(0, sparse(8))");
+  COMPILE_EXEC("tAssertEq(0, sparse(0x101)) tAssertEq(0, sparse(0))");
+  COMPILE_EXEC("fn noElse x:S -> S do (\n"
+               "  var r:S = 9\n"
+               "  match(x) case 1 do (r = 1) case 2 do ret 2;\n"
+               "  r\n"
+               ")");
+  COMPILE_EXEC("tAssertEq(1, noElse(1)) tAssertEq(2, noElse(2)) tAssertEq(9, noElse(3))");
+  COMPILE_EXEC("fn full x:S -> S do (\n"
+               "  match(x) case 0 do 1  case 1 do 2  case 0xFFFFFFFF do 3  else 9\n"
+               ")");
+  COMPILE_EXEC("tAssertEq(1, full(0))  tAssertEq(2, full(1))");
+  COMPILE_EXEC("tAssertEq(3, full(0xFFFFFFFF))  tAssertEq(9, full(2))");
+  TASSERT_EQ(true,  fnHasInstr(tyFn(Kern_findTy(k, SLC("dense"))),  SZ2 | JTBL));
+  TASSERT_EQ(false, fnHasInstr(tyFn(Kern_findTy(k, SLC("sparse"))), SZ2 | JTBL));
+  TASSERT_EQ(false, fnHasInstr(tyFn(Kern_findTy(k, SLC("full"))),   SZ2 | JTBL));
+  REPL_END
+END_TEST_FNGI
+
 TEST_FNGI(global, 10)
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("var a:S = 32");
   TyVar* a = tyVar(Kern_findTy(k, SLC("a")));
   TASSERT_EQ(0, Stk_len(WS));
@@ -371,15 +700,249 @@ TEST_FNGI(global, 10)
 END_TEST_FNGI
 
 TEST_FNGI(mod, 10)
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("mod foo ( fn one -> S do 1 )");
   COMPILE_EXEC("imm#tAssertEq(1, foo.one())");
   COMPILE_EXEC("loc:foo ( imm#tAssertEq(1, one()) )");
   REPL_END
 END_TEST_FNGI
 
+TEST_FNGI(symbols, 10)
+  REPL_START
+  COMPILE_EXEC("fn a1 -> S do 1  fn a2 -> S do 2  fn a3 -> S do 3"); // sorted
+  COMPILE_EXEC("mod m ( fn a2 -> S do 0x22 )");
+  COMPILE_EXEC("fn shadow a1:S -> S do ( a1 + a2() )"); // the local a1
+  COMPILE_EXEC("tAssertEq(7, shadow(5))  loc:m ( tAssertEq(0x25, a2() + a3()) )");
+  TASSERT_EQ(NULL, Kern_findTy(k, SLC("a4")));
+  // names are interned, so the local a1 shares the key of fn a1
+  TASSERT_EQ(Kern_findTy(k, SLC("a1"))->bst.key, tyFn(Kern_findTy(k, SLC("shadow")))->inp->name);
+  TASSERT_EQ(Kern_intern(k, SLC("a2"), NULL), Kern_findTy(k, SLC("a2"))->bst.key);
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(symbolsGrow, 40)
+  // past the first block the name and sym tables grow
+  U1 nm[5] = "s0000"; Slc s = { nm, 5 }; Ty* tys[1500];
+  for(U2 i = 0; i < 1500; i++) {
+    nm[1] = '0' + i / 1000; nm[2] = '0' + i / 100 % 10;
+    nm[3] = '0' + i / 10 % 10; nm[4] = '0' + i % 10;
+    tys[i] = Ty_new(k, TY_VAR, Kern_intern(k, s, NULL));
+  }
+  TASSERT_EQ(true, k->g.names.blkLen > 1);
+  TASSERT_EQ(true, k->g.syms.blkLen > 1);
+  for(U2 i = 0; i < 1500; i++) {
+    nm[1] = '0' + i / 1000; nm[2] = '0' + i / 100 % 10;
+    nm[3] = '0' + i / 10 % 10; nm[4] = '0' + i % 10;
+    TASSERT_EQ(tys[i], Kern_findTy(k, s));
+    TASSERT_EQ(tys[i]->bst.key, Kern_intern(k, s, NULL));
+  }
+END_TEST_FNGI
+
+U2 bstDepth(CBst* n) {
+  if(not n) return 0;
+  U2 l = bstDepth(n->l), r = bstDepth(n->r);
+  return 1 + ((l > r) ? l : r);
+}
+
+TEST_FNGI(builtins, 10)
+  REPL_START
+  DictStk* dicts = &k->g.dictStk;
+  TASSERT_EQ(&Ty_builtins, dicts->dat[dicts->cap - 1]);
+  TyFn* swp = tyFn(Kern_findTy(k, SLC("swp")));
+  TASSERT_EQ(true, isFnNative(swp) and isFnInline(swp));
+  TASSERT_EQ((Ty*)swp, TyDict_find(&Ty_builtins, SLC("swp")));
+  TASSERT_EQ(swp->bst.key, Kern_intern(k, SLC("swp"), NULL));
+#ifdef FNGI_FUEL // conditional builtins are leaves
+  TASSERT_EQ(true, bstDepth(TyDict_bst(&Ty_builtins)) <= 9);
+#else
+  TASSERT_EQ(true, bstDepth(TyDict_bst(&Ty_builtins)) <= 7);
+#endif
+
+  // rootDict shadows the (constant) builtins
+  COMPILE_EXEC("fn swp -> S do 7  tAssertEq(7, swp())");
+  TASSERT_EQ((Ty*)swp, TyDict_find(&Ty_builtins, SLC("swp")));
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(fibers, 64)
+  REPL_START
+  COMPILE_EXEC("var log:S = 0");
+  COMPILE_EXEC("fn note x:S do ( log = ((log * 10) + x) )");
+  COMPILE_EXEC("fn a do ( note(1); yld; note(3) )");
+  COMPILE_EXEC("fn b do ( note(2); yld; note(4) )");
+  COMPILE_EXEC("fn run do ( var fa:S = spawn a; var fb:S = spawn b; join fa; join fb )");
+  COMPILE_EXEC("run;  tAssertEq(1234, log)");
+
+  // spawned fibers are done when executeLoop returns, joining them is a noop
+  COMPILE_EXEC("fn c -> S do ( var f:S = spawn b; note(5); f )");
+  COMPILE_EXEC("log = 0; c;");
+  FnFiber* fb = Kern_fiber(k, WS_POP());
+  TASSERT_EQ(FIBER_DONE, fb->state);
+  COMPILE_EXEC("tAssertEq(524, log)");
+
+  // a handle of a fiber which was reused is stale: joining it is a noop
+  COMPILE_EXEC("fn stale do ( var f:S = spawn a; join f; var g:S = spawn b;\n"
+               "  join f; note(9); join g )");
+  COMPILE_EXEC("log = 0; stale; tAssertEq(13924, log)");
+
+  // an uncaught panic only ends the fiber it happened in (prints the panic)
+  COMPILE_EXEC("fn bad do ( note(6); tAssertEq(1, 2); note(7) )");
+  COMPILE_EXEC("log = 0; join(spawn bad); note(8); tAssertEq(68, log)");
+  TASSERT_EQ(NULL, k->ready.head);
+
+  // fibers are sized by their fn and reused from the pool once done
+  TyFn* fa = tyFn(Kern_findTy(k, SLC("a")));
+  COMPILE_EXEC("fn deep n:S -> S do ( if(n == 0) do ret 0; deep(dec(n)) )");
+  TASSERT_EQ(FIBER_SMALL, fnFiberCls(fa));
+  TASSERT_EQ(FIBER_LARGE, fnFiberCls(tyFn(Kern_findTy(k, SLC("deep")))));
+  FnFiber* f = Kern_spawn(k, fa); COMPILE_EXEC("log = 0"); // runs after
+  COMPILE_EXEC("tAssertEq(13, log)");
+  TASSERT_EQ(f, Kern_spawn(k, fa)); COMPILE_EXEC("log = 0");
+
+  COMPILE_EXEC("fn tick do ( log = (log + 1); yld; log = (log + 1) )");
+  TyFn* tick = tyFn(Kern_findTy(k, SLC("tick")));
+  for(U2 i = 0; i < 500; i++) Kern_spawn(k, tick);
+  COMPILE_EXEC("log = 0; yld; tAssertEq(500, log)"); // all fibers yielded once
+  U2 pooled = 0; for(f = k->fiberPool[FIBER_SMALL]; f; f = f->next) pooled += 1;
+  TASSERT_EQ(true, pooled >= 500);
+  COMPILE_EXEC("assertWsEmpty;");
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(chans, 20)
+  REPL_START
+  Chan* c = Kern_chan(k, 2, false); S v = 0;
+  TASSERT_EQ(false, Chan_tryRecv(k, c, &v));
+  TASSERT_EQ(true, Chan_trySend(k, c, 7)); TASSERT_EQ(true, Chan_trySend(k, c, 8));
+  TASSERT_EQ(false, Chan_trySend(k, c, 9));
+  TASSERT_EQ(true, Chan_tryRecv(k, c, &v)); TASSERT_EQ(7, v);
+  TASSERT_EQ(true, Chan_trySend(k, c, 9)); // wraps around
+  TASSERT_EQ(true, Chan_tryRecv(k, c, &v)); TASSERT_EQ(8, v);
+  TASSERT_EQ(true, Chan_tryRecv(k, c, &v)); TASSERT_EQ(9, v);
+  Kern_chanFree(k, c); TASSERT_EQ(c, Kern_chan(k, 3, true)); // reused
+  TASSERT_EQ(3, c->mask); Kern_chanFree(k, c);
+  EXPECT_ERR(Kern_chan(k, 0x10001, true)); // checked before narrowing
+
+  COMPILE_EXEC("var ch:Chan = chan(2);  var sum:S = 0");
+  COMPILE_EXEC("fn prod do ( send(ch, 1); send(ch, 2); send(ch, 3); send(ch, 4) )");
+  COMPILE_EXEC("fn take do ( sum = ((sum * 10) + recv ch) )");
+  COMPILE_EXEC("fn cons do ( take(); take(); take(); take() )");
+  // the producer blocks on a full chan
+  COMPILE_EXEC("fn run do ( var p:S = spawn prod; cons(); join p )");
+  COMPILE_EXEC("run;  tAssertEq(1234, sum)");
+  // the consumer blocks on an empty chan, a 1 slot chan blocks on every value
+  COMPILE_EXEC("fn run2 do ( var c:S = spawn cons; prod(); join c )");
+  COMPILE_EXEC("sum = 0; run2;  tAssertEq(1234, sum)");
+  COMPILE_EXEC("chanFree(ch); ch = chanSpsc(1); sum = 0; run;  tAssertEq(1234, sum)");
+  COMPILE_EXEC("sum = 0; run2;  tAssertEq(1234, sum)");
+#ifndef FNGI_MT // which waits for another Kern to send
+  // a recv which can never complete panics and leaves the chan
+  EXPECT_ERR(COMPILE_EXEC("recv ch"));
+  Stk_clear(WS); TASSERT_EQ(0, k->parked);
+  COMPILE_EXEC("send(ch, 5); tAssertEq(5, recv ch)");
+#endif
+  COMPILE_EXEC("assertWsEmpty;");
+  REPL_END
+END_TEST_FNGI
+
+#ifdef FNGI_FUEL
+TEST_FNGI(fuel, 20)
+  REPL_START
+  COMPILE_EXEC("var log:S = 0");
+  COMPILE_EXEC("fn note x:S do ( log = ((log * 10) + x) )");
+  COMPILE_EXEC("fn spin n:S do ( blk( if(n == 0) do ret;  n = dec(n);  cont; ) )");
+  U4 used = FnFiber_fuelUsed(k->fb);
+  COMPILE_EXEC("spin(100)");
+  TASSERT_EQ(true, FnFiber_fuelUsed(k->fb) - used >= 100);
+  TASSERT_EQ(FUEL_INF, FnFiber_fuel(k->fb));
+
+  // a slice preempts a fiber which doesn't yield
+  COMPILE_EXEC("fn a do ( note(1); spin(50); note(3) )");
+  COMPILE_EXEC("fn b do ( note(2) )");
+  COMPILE_EXEC("fn run do ( var fa:S = spawn a; var fb:S = spawn b; join fa; join fb )");
+  COMPILE_EXEC("run;  tAssertEq(132, log)");
+  k->fuelSlice = 10;
+  COMPILE_EXEC("log = 0; run;  tAssertEq(123, log)");
+  k->fuelSlice = 0;
+
+  // running out of fuel panics (ending only that fiber)
+  COMPILE_EXEC("fn c do ( var f:S = spawn a; setFuel(f, 40, 0); tAssertEq(40, fuel(f)) )");
+  COMPILE_EXEC("log = 0; c; yld; note(4); tAssertEq(14, log)");
+  COMPILE_EXEC("setFuel(fiber(), 1000, 0); spin(10); tAssertEq(1, fuel(fiber()) < 990)");
+  COMPILE_EXEC("assertWsEmpty;");
+  REPL_END
+END_TEST_FNGI
+#endif
+
+TEST_FNGI(kerns, 20) // kernels only share the (constant) builtins
+  FnFiber fb2 = {0}; assert(FnFiber_initBA(&fb2, &civ.ba));
+  Kern k2; Kern_initBA(&k2, &civ.ba, &fb2);
+  REPL_START
+  COMPILE_EXEC("fn one -> S do 1");
+  { Kern* k = &k2; REPL_START
+    COMPILE_EXEC("fn one -> S do 11;  tAssertEq(11, one())");
+    TASSERT_EQ(&k->g.replInfo, k->g.srcInfo);
+    REPL_END }
+  COMPILE_EXEC("tAssertEq(1, one())");
+  TASSERT_EQ(Kern_findTy(k, SLC("swp")), Kern_findTy(&k2, SLC("swp")));
+  TASSERT_EQ(true, Kern_findTy(k, SLC("one")) != Kern_findTy(&k2, SLC("one")));
+  REPL_END
+END_TEST_FNGI
+
+#ifdef FNGI_MT
+// A Kern on its own thread. Two of them pass values over a chan while both
+// panic: in a spawned fiber (caught by its executeLoop), then through the
+// thread's own errJmp with an uncaught panic and a Stk underflow.
+typedef struct {
+  Kern k; FnFiber fb; Chan* ch; bool send; S sum; U1 panics;
+} KernThread;
+
+static void* kernThread(void* arg) {
+  KernThread* t = arg; Kern* k = &t->k; fngiK = k;
+  jmp_buf j; fngiErrJmp = &j;
+  if(setjmp(j)) t->panics += 1;
+  if(0 == t->panics) {
+    WS_ADD((S)t->ch);
+    Slc run = t->send ? SLC("runSend") : SLC("runRecv");
+    executeFn(k, tyFn(Kern_findTy(k, run)));
+    if(not t->send) t->sum = WS_POP();
+    executeFn(k, tyFn(Kern_findTy(k, SLC("bad"))));
+  } else if(1 == t->panics) WS_POP();
+  fngiErrJmp = NULL;
+  return NULL;
+}
+
+TEST_FNGI(threads, 40)
+  Chan* ch = Kern_chan(k, 4, false);
+  KernThread t[2] = { { .ch = ch, .send = true }, { .ch = ch } };
+  for(U1 i = 0; i < 2; i++) {
+    assert(FnFiber_initBA(&t[i].fb, &civ.ba));
+    Kern* k = &t[i].k; Kern_initBA(k, &civ.ba, &t[i].fb); fngiK = k;
+    REPL_START
+    COMPILE_EXEC("fn bad do tAssertEq(1, 2)");
+    COMPILE_EXEC("fn runSend c:Chan do ( join(spawn bad);  var n:S = 1000\n"
+                 "  blk( if(n == 0) do ret;  send(c, n);  n = dec(n);  cont; ) )");
+    COMPILE_EXEC("fn runRecv c:Chan -> S do ( join(spawn bad);  var n:S = 1000\n"
+                 "  var s:S = 0\n"
+                 "  blk( if(n == 0) do brk s;  s = (s + recv c);  n = dec(n);\n"
+                 "       cont; ) )");
+    COMPILE_EXEC("join(spawn bad)"); // pools a fiber, so the threads only execute
+    REPL_END
+  }
+  fngiK = k;
+  pthread_t th[2];
+  for(U1 i = 0; i < 2; i++) {
+    assert(0 == pthread_create(&th[i], NULL, kernThread, &t[i]));
+  }
+  for(U1 i = 0; i < 2; i++) assert(0 == pthread_join(th[i], NULL));
+  TASSERT_EQ(500500, t[1].sum);
+  TASSERT_EQ(2, t[0].panics); TASSERT_EQ(2, t[1].panics);
+  Kern_chanFree(k, ch);
+END_TEST_FNGI
+#endif
+
 TEST_FNGI(structDeep, 12)
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("struct A [ a: S ]");
   COMPILE_EXEC("struct B [ a: A; b: S ]");
   COMPILE_EXEC("struct C [a: &A, b: &B]")
@@ -407,10 +970,14 @@ TEST_FNGI(structDeep, 12)
 END_TEST_FNGI
 
 TEST_FNGI(method, 20)
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("struct A [ v:S; meth aDo self: &A, x: S -> S do ( self.v + x ) ]")
   COMPILE_EXEC("fn callADo x:S a:A -> S do ( a.aDo(x) )");
   COMPILE_EXEC("tAssertEq(8, callADo(3, A 5)) assertWsEmpty;");
+  COMPILE_EXEC("struct B [ v:S; inline meth bGet self: &B, i: S -> S do ( self.v + i ) ]")
+  COMPILE_EXEC("fn callBGet b:B -> S do ( b.bGet(3) )");
+  TASSERT_EQ(false, fnHasInstr(tyFn(Kern_findTy(k, SLC("callBGet"))), XL));
+  COMPILE_EXEC("tAssertEq(7, callBGet(B 4)) assertWsEmpty;");
 
   COMPILE_EXEC("loc:A( fn nonMeth x:S -> S do ( 7 + x ) )")
   COMPILE_EXEC("fn callNonMeth x:S a:A -> S do ( a.nonMeth(x) )");
@@ -427,7 +994,7 @@ TEST_FNGI(method, 20)
 END_TEST_FNGI
 
 TEST_FNGI(prelib, 20) // tests necessary for libraries
-  Kern_fns(k); REPL_START
+  REPL_START
   COMPILE_EXEC("4"); TASSERT_WS(4);
   COMPILE_EXEC("fn getPtrs x:S -> &S, &S do (&x, ptrAdd(&x, 1, 10)) getPtrs(5)")
   WS_POP2(S x, S xPlus1);
@@ -437,8 +1004,44 @@ TEST_FNGI(prelib, 20) // tests necessary for libraries
   REPL_END
 END_TEST_FNGI
 
+// tests/aot.c is the output of Kern_aot for these fns (regenerate it if they
+// or their compiled code change).
+U2 aotTest_load(Kern* k, TyDict* dict);
+static void aotDefine(Kern* k) {
+  COMPILE_EXEC("var aotG:S = 3");
+  COMPILE_EXEC("fn aotSum n:S -> S do (\n"
+               "  var s: S = aotG\n"
+               "  blk( if(n == 0) do brk s;  s = (s + n);  n = dec(n);  cont; )\n"
+               ")");
+  COMPILE_EXEC("fn aotChk n:S do ( tAssertEq(aotSum(n), (n * (n + 1)) / 2 + 3) )");
+}
+
+TEST_FNGI(aot, 10)
+  REPL_START
+  aotDefine(k);
+  // make test fails if this differs from tests/aot.c, see make aot
+  FILE* f = fopen("bin/aot.c", "w"); ASSERT(f, "open bin/aot.c");
+  TASSERT_EQ(2, Kern_aot(k, f, &k->g.rootDict, "aotTest"));
+  fclose(f);
+  REPL_END
+END_TEST_FNGI
+
+TEST_FNGI(aotLoad, 10)
+  REPL_START
+  aotDefine(k);
+  COMPILE_EXEC("aotSum(0)  aotSum(1)  aotSum(7)  aotSum(1000)");
+  S want[4]; for(U1 i = 0; i < 4; i++) want[i] = WS_POP(); // interpreted
+  TASSERT_EQ(2, aotTest_load(k, &k->g.rootDict));
+  TASSERT_EQ(true, isFnNative(tyFn(Kern_findTy(k, SLC("aotSum")))));
+  COMPILE_EXEC("aotSum(0)  aotSum(1)  aotSum(7)  aotSum(1000)");
+  for(U1 i = 0; i < 4; i++) TASSERT_EQ(want[i], WS_POP());
+  COMPILE_EXEC("aotChk(50)");
+  COMPILE_EXEC("aotG = 10  tAssertEq(65, aotSum(10))");
+  TASSERT_EMPTY();
+  REPL_END
+END_TEST_FNGI
+
 TEST_FNGI(file_basic, 20)
-  Kern_fns(k);
   N_assertWsEmpty(k);
   CStr_ntVar(path, "\x0E", "tests/basic.fn");
   compilePath(k, path);
@@ -451,7 +1054,6 @@ END_TEST_FNGI
 // END_TEST_FNGI
 
 TEST_FNGI(repl, 20)
-  Kern_fns(k);
   simpleRepl(k);
 END_TEST_FNGI
 
@@ -471,23 +1073,56 @@ int main(int argc, char* argv[]) {
   test_basic();
   test_init();
   test_call();
+  test_wsOverflow();
   test_scan();
   test_compile0();
   test_compile1();
   test_inlineFns();
   test_comment();
   test_tyDb();
+  test_tyIIntern();
   test_compileTy();
   test_compileIf();
   test_compileBlk();
   test_compileVar();
   test_compileStruct();
   test_structBrackets();
+  test_peephole();
+  test_inlineUser();
+  test_optimize();
+  test_relaxJmps();
+  test_hotLoop();
+  test_hotMutual();
+#ifdef FNGI_PROF
+  test_prof();
+#endif
+#ifdef FNGI_STATS
+  test_fnStats();
+#endif
+#ifdef FNGI_HIST
+  test_hist();
+#endif
+  test_tailCall();
+  test_match();
   test_global();
   test_mod();
+  test_symbols();
+  test_symbolsGrow();
+  test_builtins();
+  test_fibers();
+  test_chans();
+#ifdef FNGI_FUEL
+  test_fuel();
+#endif
+  test_kerns();
+#ifdef FNGI_MT
+  test_threads();
+#endif
   test_structDeep();
   test_method();
   test_prelib();
+  test_aot();
+  test_aotLoad();
   test_file_basic();
   // test_file_dat();
   eprintf("# Tests complete\n");